@@ -43,6 +43,10 @@ struct Blinds : Module {
 		NUM_LIGHTS
 	};
 
+	LightDivider lightDivider;
+
+	Profiler profiler{"Blinds", {"Process"}};
+
 	Blinds() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		for (int c = 0; c < 4; c++) {
@@ -55,20 +59,54 @@ struct Blinds : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
-		float out = 0.0;
+		PROFILE_SCOPE(profiler, 0);
+
+		simd::float_4 out[4] = {};
+		// Number of channels summed into `out` by the rows above
+		int carried = 1;
+		bool updateLights = lightDivider.process();
+		float lightTime = lightDivider.getSampleTime(args);
 
 		for (int i = 0; i < 4; i++) {
-			float g = params[GAIN1_PARAM + i].getValue();
-			g += params[MOD1_PARAM + i].getValue() * inputs[CV1_INPUT + i].getVoltage() / 5.0;
-			g = clamp(g, -2.0f, 2.0f);
-			lights[CV1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, g), args.sampleTime);
-			lights[CV1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -g), args.sampleTime);
-			out += g * inputs[IN1_INPUT + i].getNormalVoltage(5.0);
-			lights[OUT1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, out / 5.0), args.sampleTime);
-			lights[OUT1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -out / 5.0), args.sampleTime);
+			float gain = params[GAIN1_PARAM + i].getValue();
+			float mod = params[MOD1_PARAM + i].getValue();
+			bool inConnected = inputs[IN1_INPUT + i].isConnected();
+			int channels = std::max(carried, inputs[IN1_INPUT + i].getChannels());
+			channels = std::max(channels, inputs[CV1_INPUT + i].getChannels());
+			// A mono sum carried from the rows above applies to every channel of a wider row
+			if (carried == 1) {
+				simd::float_4 mono = out[0][0];
+				for (int c = 0; c < channels; c += 4) {
+					out[c / 4] = mono;
+				}
+			}
+
+			simd::float_4 g0;
+			for (int c = 0; c < channels; c += 4) {
+				simd::float_4 g = gain + mod * inputs[CV1_INPUT + i].getPolyVoltageSimd<simd::float_4>(c) / 5.f;
+				g = simd::clamp(g, -2.f, 2.f);
+				if (c == 0)
+					g0 = g;
+				simd::float_4 in = inConnected ? inputs[IN1_INPUT + i].getPolyVoltageSimd<simd::float_4>(c) : 5.f;
+				out[c / 4] += g * in;
+			}
+
+			if (updateLights) {
+				lights[CV1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, g0[0]), lightTime);
+				lights[CV1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -g0[0]), lightTime);
+				lights[OUT1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, out[0][0] / 5.0), lightTime);
+				lights[OUT1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -out[0][0] / 5.0), lightTime);
+			}
 			if (outputs[OUT1_OUTPUT + i].isConnected()) {
-				outputs[OUT1_OUTPUT + i].setVoltage(out);
-				out = 0.0;
+				outputs[OUT1_OUTPUT + i].setChannels(channels);
+				for (int c = 0; c < channels; c += 4) {
+					outputs[OUT1_OUTPUT + i].setVoltageSimd(out[c / 4], c);
+					out[c / 4] = 0.f;
+				}
+				carried = 1;
+			}
+			else {
+				carried = channels;
 			}
 		}
 	}
@@ -120,6 +158,11 @@ struct BlindsWidget : ModuleWidget {
 		addChild(createLight<MediumLight<GreenRedLight>>(Vec(152, 245), module, Blinds::OUT3_POS_LIGHT));
 		addChild(createLight<MediumLight<GreenRedLight>>(Vec(152, 324), module, Blinds::OUT4_POS_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Blinds* module = dynamic_cast<Blinds*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
@@ -4,6 +4,11 @@
 #include "braids/signature_waveshaper.h"
 
 
+// Indexed by SettingsData::resolution and SettingsData::sample_rate, as in the firmware
+static const uint16_t bit_reduction_masks[] = {0xc000, 0xe000, 0xf000, 0xf800, 0xff00, 0xfff0, 0xffff};
+static const uint16_t decimation_factors[] = {24, 12, 6, 4, 3, 2, 1};
+
+
 struct Braids : Module {
 	enum ParamIds {
 		FINE_PARAM,
@@ -28,15 +33,25 @@ struct Braids : Module {
 		NUM_OUTPUTS
 	};
 
-	braids::MacroOscillator osc;
+	braids::MacroOscillator osc[16];
 	braids::SettingsData settings;
-	braids::VcoJitterSource jitter_source;
+	braids::VcoJitterSource jitter_source[16];
 	braids::SignatureWaveshaper ws;
 
-	dsp::SampleRateConverter<1> src;
-	dsp::DoubleRingBuffer<dsp::Frame<1>, 256> outputBuffer;
-	bool lastTrig = false;
+	dsp::SampleRateConverter<16> src;
+	dsp::DoubleRingBuffer<dsp::Frame<16>, 256> outputBuffer;
+	bool lastTrig[16] = {};
+	/** Trigger edges collected since the last render, positioned at the 96 kHz sample where they fall in the next block */
+	uint8_t sync_buffer[16][24] = {};
+	int syncFrame = 0;
+	int channels = 1;
 	bool lowCpu = false;
+	/** Whether the CPU governor may switch to low CPU mode */
+	bool governed = false;
+	/** Low CPU mode of the block being rendered, including the governor's */
+	bool renderLowCpu = false;
+
+	Profiler profiler{"Braids", {"Process", "Render", "SRC"}};
 
 	Braids() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
@@ -54,10 +69,12 @@ struct Braids : Module {
 		configInput(COLOR_INPUT, "Color");
 		configOutput(OUT_OUTPUT, "Audio");
 
-		std::memset(&osc, 0, sizeof(osc));
-		osc.Init();
-		std::memset(&jitter_source, 0, sizeof(jitter_source));
-		jitter_source.Init();
+		for (int c = 0; c < 16; c++) {
+			std::memset(&osc[c], 0, sizeof(osc[c]));
+			osc[c].Init();
+			std::memset(&jitter_source[c], 0, sizeof(jitter_source[c]));
+			jitter_source[c].Init();
+		}
 		std::memset(&ws, 0, sizeof(ws));
 		ws.Init(0x0000);
 		std::memset(&settings, 0, sizeof(settings));
@@ -66,77 +83,111 @@ struct Braids : Module {
 		settings.meta_modulation = 0;
 		settings.vco_drift = 0;
 		settings.signature = 0;
+		settings.resolution = 6;
+		settings.sample_rate = 6;
+
+		staggerBlocks(outputBuffer, 24 * APP->engine->getSampleRate() / 96000);
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// Trigger
-		bool trig = inputs[TRIG_INPUT].getVoltage() >= 1.0;
-		if (!lastTrig && trig) {
-			osc.Strike();
+		// Rising edges strike the oscillator immediately and are also recorded as sync pulses for the next block.
+		float renderRate = renderLowCpu ? args.sampleRate : 96000.f;
+		int syncIndex = std::min((int) (syncFrame * renderRate * args.sampleTime), 23);
+		for (int c = 0; c < channels; c++) {
+			bool trig = inputs[TRIG_INPUT].getPolyVoltage(c) >= 1.0;
+			if (!lastTrig[c] && trig) {
+				osc[c].Strike();
+				sync_buffer[c][syncIndex] = 1;
+			}
+			lastTrig[c] = trig;
 		}
-		lastTrig = trig;
+		syncFrame++;
 
 		// Render frames
 		if (outputBuffer.empty()) {
-			float fm = params[FM_PARAM].getValue() * inputs[FM_INPUT].getVoltage();
+			renderLowCpu = lowCpu || (governed && getCpuGovernorLevel() >= 1);
 
 			// Set shape
 			int shape = std::round(params[SHAPE_PARAM].getValue() * braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
 			if (settings.meta_modulation) {
+				float fm = params[FM_PARAM].getValue() * inputs[FM_INPUT].getVoltage();
 				shape += std::round(fm / 10.0 * braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
 			}
 			settings.shape = clamp(shape, 0, braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
 
-			// Setup oscillator from settings
-			osc.set_shape((braids::MacroOscillatorShape) settings.shape);
-
-			// Set timbre/modulation
-			float timbre = params[TIMBRE_PARAM].getValue() + params[MODULATION_PARAM].getValue() * inputs[TIMBRE_INPUT].getVoltage() / 5.0;
-			float modulation = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getVoltage() / 5.0;
-			int16_t param1 = rescale(clamp(timbre, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
-			int16_t param2 = rescale(clamp(modulation, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
-			osc.set_parameters(param1, param2);
-
-			// Set pitch
-			float pitchV = inputs[PITCH_INPUT].getVoltage() + params[COARSE_PARAM].getValue() + params[FINE_PARAM].getValue() / 12.0;
-			if (!settings.meta_modulation)
-				pitchV += fm;
-			if (lowCpu)
-				pitchV += std::log2(96000.f * args.sampleTime);
-			int32_t pitch = (pitchV * 12.0 + 60) * 128;
-			pitch += jitter_source.Render(settings.vco_drift);
-			pitch = clamp(pitch, 0, 16383);
-			osc.set_pitch(pitch);
-
-			// TODO: add a sync input buffer (must be sample rate converted)
-			uint8_t sync_buffer[24] = {};
-
-			int16_t render_buffer[24];
-			osc.Render(sync_buffer, render_buffer, 24);
-
-			// Signature waveshaping, decimation (not yet supported), and bit reduction (not yet supported)
+			dsp::Frame<16> in[24];
 			uint16_t signature = settings.signature * settings.signature * 4095;
-			for (size_t i = 0; i < 24; i++) {
-				const int16_t bit_mask = 0xffff;
-				int16_t sample = render_buffer[i] & bit_mask;
-				int16_t warped = ws.Transform(sample);
-				render_buffer[i] = stmlib::Mix(sample, warped, signature);
-			}
+			int decimation_factor = decimation_factors[std::min<int>(settings.sample_rate, 6)];
+			uint16_t bit_mask = bit_reduction_masks[std::min<int>(settings.resolution, 6)];
+
+			for (int c = 0; c < channels; c++) {
+				float fm = params[FM_PARAM].getValue() * inputs[FM_INPUT].getPolyVoltage(c);
+
+				// Setup oscillator from settings
+				osc[c].set_shape((braids::MacroOscillatorShape) settings.shape);
+
+				// Set timbre/modulation
+				float timbre = params[TIMBRE_PARAM].getValue() + params[MODULATION_PARAM].getValue() * inputs[TIMBRE_INPUT].getPolyVoltage(c) / 5.0;
+				float modulation = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getPolyVoltage(c) / 5.0;
+				int16_t param1 = rescale(clamp(timbre, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
+				int16_t param2 = rescale(clamp(modulation, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
+				osc[c].set_parameters(param1, param2);
+
+				// Set pitch
+				float pitchV = inputs[PITCH_INPUT].getPolyVoltage(c) + params[COARSE_PARAM].getValue() + params[FINE_PARAM].getValue() / 12.0;
+				if (!settings.meta_modulation)
+					pitchV += fm;
+				if (renderLowCpu)
+					pitchV += std::log2(96000.f * args.sampleTime);
+				int32_t pitch = (pitchV * 12.0 + 60) * 128;
+				pitch += jitter_source[c].Render(settings.vco_drift);
+				pitch = clamp(pitch, 0, 16383);
+				osc[c].set_pitch(pitch);
+
+				int16_t render_buffer[24];
+				{
+					PROFILE_SCOPE(profiler, 1);
+					osc[c].Render(sync_buffer[c], render_buffer, 24);
+				}
+
+				// Decimation and bit reduction
+				if (decimation_factor > 1 || bit_mask != 0xffff) {
+					int16_t sample = 0;
+					for (int i = 0; i < 24; i++) {
+						if (i % decimation_factor == 0)
+							sample = render_buffer[i] & bit_mask;
+						render_buffer[i] = sample;
+					}
+				}
+
+				// Signature waveshaping
+				if (signature) {
+					for (int i = 0; i < 24; i++) {
+						int16_t warped = ws.Transform(render_buffer[i]);
+						render_buffer[i] = stmlib::Mix(render_buffer[i], warped, signature);
+					}
+				}
 
-			if (lowCpu) {
 				for (int i = 0; i < 24; i++) {
-					dsp::Frame<1> f;
-					f.samples[0] = render_buffer[i] / 32768.0;
-					outputBuffer.push(f);
+					in[i].samples[c] = render_buffer[i] / 32768.0;
 				}
 			}
-			else {
-				// Sample rate convert
-				dsp::Frame<1> in[24];
+			std::memset(sync_buffer, 0, sizeof(sync_buffer));
+			syncFrame = 0;
+
+			if (renderLowCpu) {
 				for (int i = 0; i < 24; i++) {
-					in[i].samples[0] = render_buffer[i] / 32768.0;
+					outputBuffer.push(in[i]);
 				}
+			}
+			else {
+				// Sample rate convert all channels at once
+				PROFILE_SCOPE(profiler, 2);
 				src.setRates(96000, args.sampleRate);
+				src.setChannels(channels);
 
 				int inLen = 24;
 				int outLen = outputBuffer.capacity();
@@ -147,8 +198,19 @@ struct Braids : Module {
 
 		// Output
 		if (!outputBuffer.empty()) {
-			dsp::Frame<1> f = outputBuffer.shift();
-			outputs[OUT_OUTPUT].setVoltage(5.0 * f.samples[0]);
+			dsp::Frame<16> f = outputBuffer.shift();
+			for (int c = 0; c < channels; c++) {
+				outputs[OUT_OUTPUT].setVoltage(5.0 * f.samples[c], c);
+			}
+		}
+		outputs[OUT_OUTPUT].setChannels(channels);
+
+		// The channel count only changes once the buffered frames have been played out.
+		if (outputBuffer.empty()) {
+			channels = 1;
+			for (int i = 0; i < NUM_INPUTS; i++) {
+				channels = std::max(channels, inputs[i].getChannels());
+			}
 		}
 	}
 
@@ -162,8 +224,12 @@ struct Braids : Module {
 		}
 		json_object_set_new(rootJ, "settings", settingsJ);
 
+		json_object_set_new(rootJ, "resolution", json_integer(settings.resolution));
+		json_object_set_new(rootJ, "sampleRate", json_integer(settings.sample_rate));
+
 		json_t* lowCpuJ = json_boolean(lowCpu);
 		json_object_set_new(rootJ, "lowCpu", lowCpuJ);
+		json_object_set_new(rootJ, "governed", json_boolean(governed));
 
 		return rootJ;
 	}
@@ -179,10 +245,26 @@ struct Braids : Module {
 			}
 		}
 
+		// Patches from before bit reduction and decimation were supported stored zeros for these settings, so only trust the dedicated keys.
+		settings.resolution = 6;
+		json_t* resolutionJ = json_object_get(rootJ, "resolution");
+		if (resolutionJ)
+			settings.resolution = clamp((int) json_integer_value(resolutionJ), 0, 6);
+
+		settings.sample_rate = 6;
+		json_t* sampleRateJ = json_object_get(rootJ, "sampleRate");
+		if (sampleRateJ)
+			settings.sample_rate = clamp((int) json_integer_value(sampleRateJ), 0, 6);
+
 		json_t* lowCpuJ = json_object_get(rootJ, "lowCpu");
 		if (lowCpuJ) {
 			lowCpu = json_boolean_value(lowCpuJ);
 		}
+
+		json_t* governedJ = json_object_get(rootJ, "governed");
+		if (governedJ) {
+			governed = json_boolean_value(governedJ);
+		}
 	}
 
 	int getShapeParam() {
@@ -327,6 +409,15 @@ struct BraidsWidget : ModuleWidget {
 		addChild(display);
 	}
 
+	void step() override {
+		Braids* module = dynamic_cast<Braids*>(this->module);
+
+		if (module && module->governed)
+			stepCpuGovernor();
+
+		ModuleWidget::step();
+	}
+
 	void appendContextMenu(Menu* menu) override {
 		Braids* module = dynamic_cast<Braids*>(this->module);
 
@@ -353,7 +444,30 @@ struct BraidsWidget : ModuleWidget {
 			[=](bool val) {module->settings.signature = val ? 4 : 0;}
 		));
 
+		menu->addChild(createIndexPtrSubmenuItem("BITS: Bit depth", {
+			"2 bits",
+			"3 bits",
+			"4 bits",
+			"5 bits",
+			"8 bits",
+			"12 bits",
+			"16 bits",
+		}, &module->settings.resolution));
+
+		menu->addChild(createIndexPtrSubmenuItem("RATE: Sample rate", {
+			"4 kHz",
+			"8 kHz",
+			"16 kHz",
+			"24 kHz",
+			"32 kHz",
+			"48 kHz",
+			"96 kHz",
+		}, &module->settings.sample_rate));
+
 		menu->addChild(createBoolPtrMenuItem("Low CPU (disable resampling)", "", &module->lowCpu));
+		appendCpuGovernorMenu(menu, &module->governed);
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
@@ -32,6 +32,11 @@ struct Branches : Module {
 	dsp::BooleanTrigger modeTriggers[2];
 	bool modes[2] = {};
 	bool outcomes[2][16] = {};
+	// Gate states seen since the last light update, so short gates still flash the lights
+	bool lightGates[2][2] = {};
+	LightDivider lightDivider;
+
+	Profiler profiler{"Branches", {"Process"}};
 
 	Branches() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -46,6 +51,11 @@ struct Branches : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
+		bool updateLights = lightDivider.process();
+		float lightTime = lightDivider.getSampleTime(args);
+
 		for (int i = 0; i < 2; i++) {
 			// Get input
 			Input* input = &inputs[IN1_INPUT + i];
@@ -97,8 +107,14 @@ struct Branches : Module {
 			outputs[OUT1A_OUTPUT + i].setChannels(channels);
 			outputs[OUT1B_OUTPUT + i].setChannels(channels);
 
-			lights[STATE_LIGHTS + i * 2 + 1].setSmoothBrightness(lightA, args.sampleTime);
-			lights[STATE_LIGHTS + i * 2 + 0].setSmoothBrightness(lightB, args.sampleTime);
+			lightGates[i][0] |= lightA;
+			lightGates[i][1] |= lightB;
+			if (updateLights) {
+				lights[STATE_LIGHTS + i * 2 + 1].setSmoothBrightness(lightGates[i][0], lightTime);
+				lights[STATE_LIGHTS + i * 2 + 0].setSmoothBrightness(lightGates[i][1], lightTime);
+				lightGates[i][0] = false;
+				lightGates[i][1] = false;
+			}
 		}
 	}
 
@@ -175,6 +191,8 @@ struct BranchesWidget : ModuleWidget {
 			"Latch",
 			"Toggle",
 		}, &module->modes[1]));
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
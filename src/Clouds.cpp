@@ -2,6 +2,61 @@
 #include "clouds/dsp/granular_processor.h"
 
 
+/** A granular processor with the memory it runs in.
+Switching quality, buffer length, or into or out of spectral mode, makes the processor clear and lay out its buffers again.
+That is too slow for the engine thread, so those changes build a new GranularEngine on the UI thread instead.
+*/
+struct GranularEngine {
+	/** Sample memory of the hardware, about 1 second of 16-bit stereo audio at 32 kHz */
+	static const int hardwareMemLen = 118784;
+	static const int ccmLen = 65536 - 128;
+	/** The processor state and its CCM working buffers, which are touched every block */
+	Arena arena{Arena::sizeOf<clouds::GranularProcessor>() + Arena::sizeOf<uint8_t>(ccmLen)};
+	/** The sample memory, which grains only read small windows of */
+	Arena sampleArena;
+	size_t memLen;
+	/** Settings the engine was built for. The engine thread never changes them in a way that reallocates buffers. */
+	clouds::PlaybackMode playback;
+	int quality;
+	clouds::GranularProcessor* processor;
+	uint8_t* block_ccm;
+	uint8_t* block_mem;
+
+	/** `bufferScale` multiplies the hardware's sample memory. */
+	GranularEngine(clouds::PlaybackMode playback, int quality, int bufferScale = 1, bool fileBacked = false) :
+		sampleArena(Arena::sizeOf<uint8_t>(hardwareMemLen * bufferScale), fileBacked),
+		memLen(hardwareMemLen * bufferScale),
+		playback(playback),
+		quality(quality) {
+		processor = arena.create<clouds::GranularProcessor>();
+		block_ccm = arena.create<uint8_t>(ccmLen);
+		block_mem = sampleArena.create<uint8_t>(memLen);
+
+		processor->Init(block_mem, memLen, block_ccm, ccmLen);
+		processor->set_playback_mode(playback);
+		processor->set_quality(quality);
+		processor->Prepare();
+	}
+
+	/** Header of the sample memory snapshot kept in patch storage.
+	The memory is stored as the processor laid it out, which is already 16-bit or µ-law depending on quality, so it is only valid for the same settings.
+	Encoding it again with mu_law.cc would only shrink the 16-bit qualities, and would need the processor's private buffer layout to decode.
+	*/
+	struct SnapshotHeader {
+		char magic[4] = {'C', 'L', 'D', 'S'};
+		uint32_t version = 1;
+		uint32_t playback = 0;
+		uint32_t quality = 0;
+		uint32_t length = 0;
+	};
+
+	/** Returns whether the processor can switch between these settings without reallocating its buffers. */
+	static bool isBenignChange(clouds::PlaybackMode fromPlayback, int fromQuality, clouds::PlaybackMode toPlayback, int toQuality) {
+		return fromQuality == toQuality && fromPlayback != clouds::PLAYBACK_MODE_SPECTRAL && toPlayback != clouds::PLAYBACK_MODE_SPECTRAL;
+	}
+};
+
+
 struct Clouds : Module {
 	enum ParamIds {
 		FREEZE_PARAM,
@@ -51,19 +106,53 @@ struct Clouds : Module {
 	dsp::DoubleRingBuffer<dsp::Frame<2>, 256> inputBuffer;
 	dsp::DoubleRingBuffer<dsp::Frame<2>, 256> outputBuffer;
 
-	uint8_t* block_mem;
-	uint8_t* block_ccm;
-	clouds::GranularProcessor* processor;
+	/** Built by backgroundInit */
+	GranularEngine* granular = NULL;
+	/** Built on the UI thread, waiting to be swapped in by the engine thread */
+	std::atomic<GranularEngine*> pendingGranular{NULL};
+	/** Swapped out by the engine thread, waiting to be deleted on the UI thread.
+	The UI thread empties these before building each new engine, so the engine thread always finds a free slot, even without a widget.
+	*/
+	std::atomic<GranularEngine*> retiredGranulars[4] = {};
+	/** Started by onAdd(), once the patch's settings and patch storage are known */
+	BackgroundInit backgroundInit;
+	/** Writes the sample memory snapshot to patch storage */
+	std::future<void> snapshotWrite;
+	/** Set by the engine thread when the Load/save button is pressed, for the UI thread to restore the saved buffer */
+	std::atomic<bool> loadRequested{false};
 
 	bool triggered = false;
 
 	dsp::SchmittTrigger freezeTrigger;
 	bool freeze = false;
+	/** Whether the last block was frozen by the button or FREEZE input */
+	bool frozen = false;
 	dsp::SchmittTrigger blendTrigger;
+	dsp::BooleanTrigger loadTrigger;
 	int blendMode = 0;
+	bool governed = false;
+
+	struct Settings {
+		clouds::PlaybackMode playback = clouds::PLAYBACK_MODE_GRANULAR;
+		int quality = 0;
+		/** Set by the CPU governor, which switches to the mono variant of the quality setting */
+		bool reduced = false;
+		/** Multiple of the hardware's buffer length. One of 1, 16, 64, or 256. */
+		int bufferScale = 1;
+		bool fileBacked = false;
+
+		int getQuality() const {
+			return reduced ? (quality | 1) : quality;
+		}
+	};
+	/** Context menu settings, applied at block boundaries */
+	SettingsBuffer<Settings> settings;
 
-	clouds::PlaybackMode playback;
-	int quality = 0;
+	// Peak level seen since the last light update
+	float lightPeak = 0.f;
+	LightDivider lightDivider;
+
+	Profiler profiler{"Clouds", {"Process", "Input SRC", "Granular", "Output SRC"}};
 
 	Clouds() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -79,7 +168,7 @@ struct Clouds : Module {
 		configParam(REVERB_PARAM, 0.0, 1.0, 0.0, "Reverb amount");
 		configButton(FREEZE_PARAM, "Freeze");
 		configButton(MODE_PARAM, "Mode");
-		configButton(LOAD_PARAM, "Load/save");
+		configButton(LOAD_PARAM, "Load saved buffer");
 		configInput(FREEZE_INPUT, "Freeze");
 		configInput(TRIG_INPUT, "Trigger");
 		configInput(POSITION_INPUT, "Position");
@@ -96,24 +185,73 @@ struct Clouds : Module {
 		configBypass(IN_L_INPUT, OUT_L_OUTPUT);
 		configBypass(IN_R_INPUT, OUT_R_OUTPUT);
 
-		const int memLen = 118784;
-		const int ccmLen = 65536 - 128;
-		block_mem = new uint8_t[memLen]();
-		block_ccm = new uint8_t[ccmLen]();
-		processor = new clouds::GranularProcessor();
-		memset(processor, 0, sizeof(*processor));
-
-		processor->Init(block_mem, memLen, block_ccm, ccmLen);
 		onReset();
+		staggerBlocks(outputBuffer, 32 * APP->engine->getSampleRate() / 32000);
 	}
 
 	~Clouds() {
-		delete processor;
-		delete[] block_mem;
-		delete[] block_ccm;
+		backgroundInit.wait();
+		if (snapshotWrite.valid())
+			snapshotWrite.wait();
+		delete granular;
+		delete pendingGranular.load();
+		freeRetiredGranulars();
+	}
+
+	void setSettings(const Settings& newSettings) {
+		Settings& s = settings.ui();
+		bool rebuild = !GranularEngine::isBenignChange(s.playback, s.getQuality(), newSettings.playback, newSettings.getQuality())
+			|| s.bufferScale != newSettings.bufferScale
+			|| s.fileBacked != newSettings.fileBacked;
+		s = newSettings;
+		freeRetiredGranulars();
+		// Until onAdd() starts building the first engine, it will pick up these settings itself.
+		// Settings changed while it is being built need a pending engine, which replaces it on the first block.
+		if (rebuild && backgroundInit.future.valid()) {
+			// Replace any engine that has not been picked up yet
+			delete pendingGranular.exchange(new GranularEngine(s.playback, s.getQuality(), s.bufferScale, s.fileBacked));
+		}
+		// The engine thread may see these settings before or after the engine built for them.
+		// Either way it only applies the parts its current engine can switch to without reallocating.
+		settings.publish();
+	}
+
+	void setPlayback(clouds::PlaybackMode playback) {
+		Settings s = settings.ui();
+		s.playback = playback;
+		setSettings(s);
+	}
+
+	void setQuality(int quality) {
+		Settings s = settings.ui();
+		s.quality = quality;
+		setSettings(s);
+	}
+
+	void setBufferScale(int bufferScale) {
+		Settings s = settings.ui();
+		s.bufferScale = bufferScale;
+		setSettings(s);
+	}
+
+	void setFileBacked(bool fileBacked) {
+		Settings s = settings.ui();
+		s.fileBacked = fileBacked;
+		setSettings(s);
+	}
+
+	/** Called from the UI thread */
+	void freeRetiredGranulars() {
+		for (std::atomic<GranularEngine*>& retired : retiredGranulars) {
+			delete retired.exchange(NULL);
+		}
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+		if (!backgroundInit.isReady())
+			return;
+
 		// Get input
 		dsp::Frame<2> inputFrame = {};
 		if (!inputBuffer.full()) {
@@ -128,6 +266,9 @@ struct Clouds : Module {
 		if (blendTrigger.process(params[MODE_PARAM].getValue())) {
 			blendMode = (blendMode + 1) % 4;
 		}
+		if (loadTrigger.process(params[LOAD_PARAM].getValue() > 0.f)) {
+			loadRequested = true;
+		}
 
 		// Trigger
 		if (inputs[TRIG_INPUT].getVoltage() >= 1.0) {
@@ -139,6 +280,7 @@ struct Clouds : Module {
 			clouds::ShortFrame input[32] = {};
 			// Convert input buffer
 			{
+				PROFILE_SCOPE(profiler, 1);
 				inputSrc.setRates(args.sampleRate, 32000);
 				dsp::Frame<2> inputFrames[32];
 				int inLen = inputBuffer.size();
@@ -153,20 +295,43 @@ struct Clouds : Module {
 				}
 			}
 
+			// Swap in the engine prebuilt for new settings
+			if (pendingGranular.load()) {
+				for (std::atomic<GranularEngine*>& retired : retiredGranulars) {
+					GranularEngine* expected = NULL;
+					if (retired.compare_exchange_strong(expected, granular)) {
+						// Only the UI thread replaces the pending engine, and never with NULL
+						granular = pendingGranular.exchange(NULL);
+						break;
+					}
+				}
+			}
+
 			// Set up processor
-			processor->set_playback_mode(playback);
-			processor->set_quality(quality);
+			settings.fetch();
+			const Settings& s = settings.engine();
+			// Quality, and switching into or out of spectral mode, are fixed by the engine, so Prepare() never reallocates buffers on this thread.
+			// Settings that arrive before the engine built for them wait for it.
+			clouds::GranularProcessor* processor = granular->processor;
+			bool benign = GranularEngine::isBenignChange(granular->playback, granular->quality, s.playback, granular->quality);
+			processor->set_playback_mode(benign ? s.playback : granular->playback);
+			processor->set_quality(granular->quality);
 			processor->Prepare();
 
 			clouds::Parameters* p = processor->mutable_parameters();
 			p->trigger = triggered;
 			p->gate = triggered;
-			p->freeze = freeze || (inputs[FREEZE_INPUT].getVoltage() >= 1.0);
+			frozen = freeze || (inputs[FREEZE_INPUT].getVoltage() >= 1.0);
+			p->freeze = frozen;
 			p->position = clamp(params[POSITION_PARAM].getValue() + inputs[POSITION_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
 			p->size = clamp(params[SIZE_PARAM].getValue() + inputs[SIZE_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
 			p->pitch = clamp((params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage()) * 12.0f, -48.0f, 48.0f);
 			p->density = clamp(params[DENSITY_PARAM].getValue() + inputs[DENSITY_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
 			p->texture = clamp(params[TEXTURE_PARAM].getValue() + inputs[TEXTURE_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
+			// Fewer grains are cheaper, and the governor can change this without rebuilding the engine.
+			// Density is distance from the center, where no new grains start.
+			if (governed && getCpuGovernorLevel() >= 1)
+				p->density = 0.5f + (p->density - 0.5f) * 0.5f;
 			p->dry_wet = params[BLEND_PARAM].getValue();
 			p->stereo_spread = params[SPREAD_PARAM].getValue();
 			p->feedback = params[FEEDBACK_PARAM].getValue();
@@ -194,10 +359,15 @@ struct Clouds : Module {
 			}
 
 			clouds::ShortFrame output[32];
-			processor->Process(input, output, 32);
+			{
+				PROFILE_SCOPE(profiler, 2);
+				DenormalGuard denormalGuard;
+				processor->Process(input, output, 32);
+			}
 
 			// Convert output buffer
 			{
+				PROFILE_SCOPE(profiler, 3);
 				dsp::Frame<2> outputFrames[32];
 				for (int i = 0; i < 32; i++) {
 					outputFrames[i].samples[0] = output[i].l / 32768.0;
@@ -223,54 +393,184 @@ struct Clouds : Module {
 		}
 
 		// Lights
-		clouds::Parameters* p = processor->mutable_parameters();
-		dsp::VuMeter vuMeter;
-		vuMeter.dBInterval = 6.0;
-		dsp::Frame<2> lightFrame = p->freeze ? outputFrame : inputFrame;
-		vuMeter.setValue(fmaxf(fabsf(lightFrame.samples[0]), fabsf(lightFrame.samples[1])));
-		lights[FREEZE_LIGHT].setBrightness(p->freeze ? 0.75 : 0.0);
-		lights[MIX_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(3), args.sampleTime);
-		lights[PAN_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(2), args.sampleTime);
-		lights[FEEDBACK_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(1), args.sampleTime);
-		lights[REVERB_GREEN_LIGHT].setBrightness(0.0);
-		lights[MIX_RED_LIGHT].setBrightness(0.0);
-		lights[PAN_RED_LIGHT].setBrightness(0.0);
-		lights[FEEDBACK_RED_LIGHT].setSmoothBrightness(vuMeter.getBrightness(1), args.sampleTime);
-		lights[REVERB_RED_LIGHT].setSmoothBrightness(vuMeter.getBrightness(0), args.sampleTime);
+		dsp::Frame<2> lightFrame = frozen ? outputFrame : inputFrame;
+		lightPeak = std::max(lightPeak, fmaxf(fabsf(lightFrame.samples[0]), fabsf(lightFrame.samples[1])));
+		if (lightDivider.process()) {
+			float lightTime = lightDivider.getSampleTime(args);
+			dsp::VuMeter vuMeter;
+			vuMeter.dBInterval = 6.0;
+			vuMeter.setValue(lightPeak);
+			lightPeak = 0.f;
+			lights[FREEZE_LIGHT].setBrightness(frozen ? 0.75 : 0.0);
+			lights[MIX_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(3), lightTime);
+			lights[PAN_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(2), lightTime);
+			lights[FEEDBACK_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(1), lightTime);
+			lights[REVERB_GREEN_LIGHT].setBrightness(0.0);
+			lights[MIX_RED_LIGHT].setBrightness(0.0);
+			lights[PAN_RED_LIGHT].setBrightness(0.0);
+			lights[FEEDBACK_RED_LIGHT].setSmoothBrightness(vuMeter.getBrightness(1), lightTime);
+			lights[REVERB_RED_LIGHT].setSmoothBrightness(vuMeter.getBrightness(0), lightTime);
+		}
 	}
 
 	void onReset() override {
 		freeze = false;
 		blendMode = 0;
-		playback = clouds::PLAYBACK_MODE_GRANULAR;
-		quality = 0;
+		setSettings(Settings());
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 
-		json_object_set_new(rootJ, "playback", json_integer((int) playback));
-		json_object_set_new(rootJ, "quality", json_integer(quality));
+		json_object_set_new(rootJ, "playback", json_integer((int) settings.ui().playback));
+		json_object_set_new(rootJ, "quality", json_integer(settings.ui().quality));
+		json_object_set_new(rootJ, "bufferScale", json_integer(settings.ui().bufferScale));
+		json_object_set_new(rootJ, "fileBacked", json_boolean(settings.ui().fileBacked));
 		json_object_set_new(rootJ, "blendMode", json_integer(blendMode));
+		json_object_set_new(rootJ, "governed", json_boolean(governed));
 
 		return rootJ;
 	}
 
 	void dataFromJson(json_t* rootJ) override {
+		Settings s = settings.ui();
 		json_t* playbackJ = json_object_get(rootJ, "playback");
 		if (playbackJ) {
-			playback = (clouds::PlaybackMode) json_integer_value(playbackJ);
+			s.playback = (clouds::PlaybackMode) json_integer_value(playbackJ);
 		}
 
 		json_t* qualityJ = json_object_get(rootJ, "quality");
 		if (qualityJ) {
-			quality = json_integer_value(qualityJ);
+			s.quality = json_integer_value(qualityJ);
 		}
 
+		json_t* bufferScaleJ = json_object_get(rootJ, "bufferScale");
+		if (bufferScaleJ) {
+			int bufferScale = json_integer_value(bufferScaleJ);
+			if (bufferScale == 1 || bufferScale == 16 || bufferScale == 64 || bufferScale == 256)
+				s.bufferScale = bufferScale;
+		}
+
+		json_t* fileBackedJ = json_object_get(rootJ, "fileBacked");
+		if (fileBackedJ) {
+			s.fileBacked = json_boolean_value(fileBackedJ);
+		}
+		// The sample memory is only restored by onAdd(), so loading a preset, pasting, or undoing keeps the live buffer
+		setSettings(s);
+
 		json_t* blendModeJ = json_object_get(rootJ, "blendMode");
 		if (blendModeJ) {
 			blendMode = json_integer_value(blendModeJ);
 		}
+
+		json_t* governedJ = json_object_get(rootJ, "governed");
+		if (governedJ) {
+			governed = json_boolean_value(governedJ);
+		}
+	}
+
+	std::string getSnapshotPath() {
+		return system::join(getPatchStorageDirectory(), "buffer.bin");
+	}
+
+	void onAdd(const AddEvent& e) override {
+		// Build the engine once, with the settings and sample memory loaded with the patch
+		Settings s = settings.ui();
+		std::string path = getSnapshotPath();
+		backgroundInit.start([this, s, path]() {
+			granular = new GranularEngine(s.playback, s.getQuality(), s.bufferScale, s.fileBacked);
+			loadSnapshot(granular, path);
+		});
+	}
+
+	void onSave(const SaveEvent& e) override {
+		freeRetiredGranulars();
+		// Skip if the running engine may not match the settings yet
+		if (!backgroundInit.isReady() || pendingGranular.load())
+			return;
+		// While the CPU governor runs the engine at a reduced quality, its memory doesn't match the saved settings, so keep the previous snapshot
+		const Settings& s = settings.ui();
+		if (granular->quality != s.quality)
+			return;
+		// The processor only stops writing its memory while frozen, so that's the only time a snapshot can be taken without interrupting the audio.
+		// Otherwise the previous snapshot stays in the patch.
+		if (!frozen)
+			return;
+		// Don't let writes pile up if saves come faster than the disk
+		if (snapshotWrite.valid())
+			snapshotWrite.wait();
+
+		// The file is written on a worker thread, so saving never holds up the UI or engine.
+		GranularEngine::SnapshotHeader header;
+		// Playback modes the engine switched between without reallocating share the memory layout, so the patch's own mode is stored
+		header.playback = s.playback;
+		header.quality = s.quality;
+		header.length = granular->memLen;
+		auto data = std::make_shared<std::vector<uint8_t>>(granular->block_mem, granular->block_mem + granular->memLen);
+		createPatchStorageDirectory();
+		std::string path = getSnapshotPath();
+
+		snapshotWrite = std::async(std::launch::async, [=]() {
+			// Write to a temporary file and rename it, so a patch archived meanwhile contains either the previous snapshot or this one, never a partial file.
+			std::string tmpPath = path + ".tmp";
+			FILE* file = std::fopen(tmpPath.c_str(), "wb");
+			if (!file) {
+				WARN("Could not write Clouds buffer to %s", tmpPath.c_str());
+				return;
+			}
+			bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+			ok = ok && std::fwrite(data->data(), 1, data->size(), file) == data->size();
+			std::fclose(file);
+			if (ok)
+				system::rename(tmpPath, path);
+			else
+				system::remove(tmpPath);
+		});
+	}
+
+	/** Replaces the running engine with one holding the buffer saved with the patch, and freezes it. Called from the UI thread. */
+	void recallSnapshot() {
+		if (!backgroundInit.isReady())
+			return;
+		// A snapshot being written is the one to recall
+		if (snapshotWrite.valid())
+			snapshotWrite.wait();
+		const Settings& s = settings.ui();
+		GranularEngine* engine = new GranularEngine(s.playback, s.getQuality(), s.bufferScale, s.fileBacked);
+		if (!loadSnapshot(engine, getSnapshotPath())) {
+			delete engine;
+			return;
+		}
+		freeRetiredGranulars();
+		delete pendingGranular.exchange(engine);
+		// Keep the recalled buffer from being recorded over
+		freeze = true;
+	}
+
+	/** Restores the sample memory saved with the patch into a newly built engine, if it was saved with the same settings. */
+	static bool loadSnapshot(GranularEngine* engine, const std::string& path) {
+		FILE* file = std::fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		DEFER({std::fclose(file);});
+
+		GranularEngine::SnapshotHeader expected;
+		expected.playback = engine->playback;
+		expected.quality = engine->quality;
+		expected.length = engine->memLen;
+		GranularEngine::SnapshotHeader header;
+		if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(&header, &expected, sizeof(header)) != 0)
+			return false;
+		// Check the length first, so a truncated file leaves the memory as the processor laid it out
+		if (system::getFileSize(path) != (int64_t) (sizeof(header) + engine->memLen)) {
+			WARN("Clouds buffer %s is truncated", path.c_str());
+			return false;
+		}
+		if (std::fread(engine->block_mem, 1, engine->memLen, file) != engine->memLen) {
+			WARN("Could not read Clouds buffer %s", path.c_str());
+			return false;
+		}
+		return true;
 	}
 };
 
@@ -346,6 +646,21 @@ struct CloudsWidget : ModuleWidget {
 		Clouds* module = dynamic_cast<Clouds*>(this->module);
 
 		if (module) {
+			module->freeRetiredGranulars();
+			if (module->loadRequested.exchange(false))
+				module->recallSnapshot();
+
+			if (module->governed)
+				stepCpuGovernor();
+			// Switching to mono rebuilds the engine, which clears its buffer and allocates it again.
+			// So only the highest governor level does it, never while frozen, and never for long buffers.
+			bool reduced = module->governed && getCpuGovernorLevel() >= 2 && module->settings.ui().bufferScale == 1;
+			if (reduced != module->settings.ui().reduced && !module->frozen) {
+				Clouds::Settings s = module->settings.ui();
+				s.reduced = reduced;
+				module->setSettings(s);
+			}
+
 			blendParam->visible = (module->blendMode == 0);
 			spreadParam->visible = (module->blendMode == 1);
 			feedbackParam->visible = (module->blendMode == 2);
@@ -386,8 +701,8 @@ struct CloudsWidget : ModuleWidget {
 		};
 		for (int i = 0; i < (int) playbackLabels.size(); i++) {
 			menu->addChild(createCheckMenuItem(playbackLabels[i], "",
-				[=]() {return module->playback == i;},
-				[=]() {module->playback = (clouds::PlaybackMode) i;}
+				[=]() {return module->settings.ui().playback == i;},
+				[=]() {module->setPlayback((clouds::PlaybackMode) i);}
 			));
 		}
 
@@ -402,10 +717,32 @@ struct CloudsWidget : ModuleWidget {
 		};
 		for (int i = 0; i < (int) qualityLabels.size(); i++) {
 			menu->addChild(createCheckMenuItem(qualityLabels[i], "",
-				[=]() {return module->quality == i;},
-				[=]() {module->quality = i;}
+				[=]() {return module->settings.ui().quality == i;},
+				[=]() {module->setQuality(i);}
 			));
 		}
+
+		static const std::vector<int> bufferScales = {1, 16, 64, 256};
+		menu->addChild(createSubmenuItem("Buffer length", string::f("%d×", module->settings.ui().bufferScale), [=](Menu* menu) {
+			for (int bufferScale : bufferScales) {
+				// At the current quality
+				int seconds = (1 << module->settings.ui().quality) * bufferScale;
+				menu->addChild(createCheckMenuItem(string::f("%d× (%d s)", bufferScale, seconds), "",
+					[=]() {return module->settings.ui().bufferScale == bufferScale;},
+					[=]() {module->setBufferScale(bufferScale);}
+				));
+			}
+		}));
+		// Writeback and page faults of the mapped file land on the engine thread
+		menu->addChild(createBoolMenuItem("Page buffer to a temporary file", "May cause dropouts",
+			[=]() {return module->settings.ui().fileBacked;},
+			[=](bool val) {module->setFileBacked(val);}
+		));
+
+		menu->addChild(new MenuSeparator);
+		appendCpuGovernorMenu(menu, &module->governed);
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
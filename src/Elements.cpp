@@ -75,8 +75,24 @@ struct Elements : Module {
 	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> inputBuffer;
 	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
 
-	uint16_t reverb_buffers[16][32768] = {};
+	Arena arena{Arena::sizeOf<elements::Part>(16) + Arena::sizeOf<uint16_t>(16 * 32768)};
 	elements::Part* parts[16];
+	uint16_t* reverb_buffers[16];
+	BackgroundInit backgroundInit;
+
+	struct Settings {
+		/** Resonator model, or -1 for the easter egg */
+		int model = 0;
+	};
+	/** Context menu settings, applied at block boundaries */
+	SettingsBuffer<Settings> settings;
+
+	// Idle voice tracking
+	bool sleeping[16] = {};
+	int silentFrames[16] = {};
+	float sleepStrength[16] = {};
+
+	Profiler profiler{"Elements", {"Process", "Input SRC", "Part", "Output SRC"}};
 
 	Elements() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -132,21 +148,24 @@ struct Elements : Module {
 		configBypass(BLOW_INPUT, AUX_OUTPUT);
 		configBypass(STRIKE_INPUT, MAIN_OUTPUT);
 
-		for (int c = 0; c < 16; c++) {
-			parts[c] = new elements::Part();
-			// In the Mutable Instruments code, Part doesn't initialize itself, so zero it here.
-			std::memset(parts[c], 0, sizeof(*parts[c]));
-			parts[c]->Init(reverb_buffers[c]);
-			// Just some random numbers
-			uint32_t seed[3] = {1, 2, 3};
-			parts[c]->Seed(seed, 3);
-		}
-	}
+		backgroundInit.start([this]() {
+			// In the Mutable Instruments code, Part doesn't initialize itself, so it relies on the arena being zeroed.
+			// All parts go before the reverb buffers, keeping the state touched every block together.
+			elements::Part* partArray = arena.create<elements::Part>(16);
+			for (int c = 0; c < 16; c++) {
+				parts[c] = &partArray[c];
+				reverb_buffers[c] = arena.create<uint16_t>(32768);
+			}
 
-	~Elements() {
-		for (int c = 0; c < 16; c++) {
-			delete parts[c];
-		}
+			for (int c = 0; c < 16; c++) {
+				parts[c]->Init(reverb_buffers[c]);
+				// Just some random numbers
+				uint32_t seed[3] = {1, 2, 3};
+				parts[c]->Seed(seed, 3);
+			}
+		});
+
+		staggerBlocks(outputBuffer, 16 * APP->engine->getSampleRate() / 32000);
 	}
 
 	void onReset() override {
@@ -154,6 +173,10 @@ struct Elements : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+		if (!backgroundInit.isReady())
+			return;
+
 		int channels = std::max(inputs[NOTE_INPUT].getChannels(), 1);
 
 		// Get input
@@ -168,12 +191,17 @@ struct Elements : Module {
 
 		// Generate output if output buffer is empty
 		if (outputBuffer.empty()) {
+			if (settings.fetch()) {
+				applyModel(settings.engine().model);
+			}
+
 			// blow[channel][bufferIndex]
 			float blow[16][16] = {};
 			float strike[16][16] = {};
 
 			// Convert input buffer
 			{
+				PROFILE_SCOPE(profiler, 1);
 				inputSrc.setRates(args.sampleRate, 32000);
 				inputSrc.setChannels(channels * 2);
 				int inLen = inputBuffer.size();
@@ -226,8 +254,47 @@ struct Elements : Module {
 				performance.gate = params[PLAY_PARAM].getValue() >= 1.f || inputs[GATE_INPUT].getPolyVoltage(c) >= 1.f;
 				performance.strength = clamp(1.f - inputs[STRENGTH_INPUT].getPolyVoltage(c) / 5.f, 0.f, 1.f);
 
+				// External exciters can sound the resonator without a gate
+				float inputEnergy = 0.f;
+				for (int i = 0; i < 16; i++) {
+					inputEnergy += blow[c][i] * blow[c][i] + strike[c][i] * strike[c][i];
+				}
+				bool excited = performance.gate || inputEnergy > 1e-8f;
+
+				if (sleeping[c] && (excited || std::fabs(performance.strength - sleepStrength[c]) > 0.01f)) {
+					sleeping[c] = false;
+					silentFrames[c] = 0;
+				}
+
+				if (sleeping[c]) {
+					std::fill(main[c], main[c] + 16, 0.f);
+					std::fill(aux[c], aux[c] + 16, 0.f);
+					continue;
+				}
+
 				// Generate audio
-				parts[c]->Process(performance, blow[c], strike[c], main[c], aux[c], 16);
+				{
+					PROFILE_SCOPE(profiler, 2);
+					DenormalGuard denormalGuard;
+					parts[c]->Process(performance, blow[c], strike[c], main[c], aux[c], 16);
+				}
+
+				// Sleep once the exciter is off and the resonator and reverb tail have decayed below -80 dB for 0.5 seconds.
+				// Since the outputs include the reverb, its tail keeps the voice awake until it has died out too.
+				float outputEnergy = 0.f;
+				for (int i = 0; i < 16; i++) {
+					outputEnergy += main[c][i] * main[c][i] + aux[c][i] * aux[c][i];
+				}
+				if (!excited && parts[c]->exciter_level() < 1e-4f && parts[c]->resonator_level() < 1e-4f && outputEnergy < 16 * 1e-8f) {
+					silentFrames[c] += 16;
+					if (silentFrames[c] >= 16000) {
+						sleeping[c] = true;
+						sleepStrength[c] = performance.strength;
+					}
+				}
+				else {
+					silentFrames[c] = 0;
+				}
 
 				// Set lights based on first poly channel
 				gateLight = std::max(gateLight, performance.gate ? 0.75f : 0.f);
@@ -242,6 +309,7 @@ struct Elements : Module {
 
 			// Convert output buffer
 			{
+				PROFILE_SCOPE(profiler, 3);
 				dsp::Frame<16 * 2> outputFrames[16];
 				for (int c = 0; c < channels; c++) {
 					for (int i = 0; i < 16; i++) {
@@ -286,16 +354,19 @@ struct Elements : Module {
 	}
 
 	int getModel() {
-		// Use the first channel's Part as the reference model
-		if (parts[0]->easter_egg())
-			return -1;
-		return (int) parts[0]->resonator_model();
+		return settings.ui().model;
 	}
 
 	/** Sets the resonator model.
 	-1 means easter egg (Ominous voice)
+	The Parts pick it up at the next block.
 	*/
 	void setModel(int model) {
+		settings.ui().model = model;
+		settings.publish();
+	}
+
+	void applyModel(int model) {
 		if (model < 0) {
 			for (int c = 0; c < 16; c++) {
 				parts[c]->set_easter_egg(true);
@@ -415,6 +486,8 @@ struct ElementsWidget : ModuleWidget {
 				[=]() {module->setModel(modelLabel.id);}
 			));
 		}
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
@@ -3,6 +3,18 @@
 #include "frames/poly_lfo.h"
 
 
+/** Maximum number of keyframes in the module's store. */
+static const int MAX_KEYFRAMES = 4096;
+/** Number of keyframes paged into frames::Keyframer at a time, well within the hardware's capacity. */
+static const int KEYFRAMER_WINDOW = 32;
+
+
+struct StoredKeyframe {
+	uint16_t timestamp;
+	uint16_t values[4];
+};
+
+
 struct Frames : Module {
 	enum ParamIds {
 		GAIN1_PARAM,
@@ -41,14 +53,34 @@ struct Frames : Module {
 		NUM_LIGHTS = FRAME_LIGHT + 3
 	};
 
+	/** All keyframes, sorted by timestamp.
+	frames::Keyframer only holds the firmware's fixed number of keyframes, so it is loaded with a window of this store around the evaluated timestamp.
+	*/
+	std::vector<StoredKeyframe> keyframes;
+	int windowStart = 0;
+	int windowEnd = 0;
+	bool windowDirty = true;
+	bool clearRequested = false;
+
 	frames::Keyframer keyframer;
 	frames::PolyLfo poly_lfo;
 	bool poly_lfo_mode = false;
 	uint16_t lastControls[4] = {};
+	LightDivider lightDivider;
+
+	// Keyframe lookups are cached and only redone when the timestamps move or the keyframes change.
+	// Set keyframerDirty after editing the keyframes or keyframer settings from outside process().
+	bool keyframerDirty = true;
+	int32_t lastTimestamp = -1;
+	int32_t lastTimestampMod = -1;
+	int16_t nearestIndex = -1;
+	float gains[4] = {};
 
 	dsp::SchmittTrigger addTrigger;
 	dsp::SchmittTrigger delTrigger;
 
+	Profiler profiler{"Frames", {"Process"}};
+
 	Frames() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(GAIN1_PARAM, 0.0, 1.0, 0.0, "Channel 1 gain");
@@ -75,6 +107,7 @@ struct Frames : Module {
 		configOutput(OUT4_OUTPUT, "Channel 4");
 		configOutput(FRAME_STEP_OUTPUT, "Frame step");
 
+		keyframes.reserve(MAX_KEYFRAMES);
 		memset(&keyframer, 0, sizeof(keyframer));
 		keyframer.Init();
 		memset(&poly_lfo, 0, sizeof(poly_lfo));
@@ -84,6 +117,8 @@ struct Frames : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// Set gain and timestamp knobs
 		uint16_t controls[4];
 		for (int i = 0; i < 4; i++) {
@@ -94,9 +129,23 @@ struct Frames : Module {
 		int32_t timestampMod = timestamp + params[MODULATION_PARAM].getValue() * inputs[FRAME_INPUT].getVoltage() / 10.0 * 65535.0;
 		timestamp = clamp(timestamp, 0, 65535);
 		timestampMod = clamp(timestampMod, 0, 65535);
-		int16_t nearestIndex = -1;
-		if (!poly_lfo_mode) {
-			nearestIndex = keyframer.FindNearestKeyframe(timestamp, 2048);
+
+		if (clearRequested) {
+			clearRequested = false;
+			keyframes.clear();
+			keyframerDirty = true;
+		}
+		bool keyframesChanged = false;
+		if (keyframerDirty) {
+			keyframerDirty = false;
+			keyframesChanged = true;
+			windowDirty = true;
+		}
+		if (poly_lfo_mode) {
+			nearestIndex = -1;
+		}
+		else if (keyframesChanged || timestamp != lastTimestamp) {
+			nearestIndex = findNearestKeyframe(timestamp, 2048);
 		}
 
 		// Render, handle buttons
@@ -114,49 +163,71 @@ struct Frames : Module {
 		else {
 			for (int i = 0; i < 4; i++) {
 				if (controls[i] != lastControls[i]) {
+					keyframesChanged = true;
 					// Update recently moved control
-					if (keyframer.num_keyframes() == 0) {
+					if (keyframes.empty()) {
 						keyframer.set_immediate(i, controls[i]);
 					}
 					if (nearestIndex >= 0) {
-						frames::Keyframe* nearestKeyframe = keyframer.mutable_keyframe(nearestIndex);
-						nearestKeyframe->values[i] = controls[i];
+						keyframes[nearestIndex].values[i] = controls[i];
+						// Edit the paged-in copy directly instead of reloading the window
+						int windowIndex = nearestIndex - windowStart;
+						if (0 <= windowIndex && windowIndex < windowEnd - windowStart) {
+							keyframer.mutable_keyframe(windowIndex)->values[i] = controls[i];
+						}
 					}
 				}
 			}
 
 			if (addTrigger.process(params[ADD_PARAM].getValue())) {
 				if (nearestIndex < 0) {
-					keyframer.AddKeyframe(timestamp, controls);
+					addKeyframe(timestamp, controls);
+					nearestIndex = findNearestKeyframe(timestamp, 2048);
+					keyframesChanged = true;
+					windowDirty = true;
 				}
 			}
 			if (delTrigger.process(params[DEL_PARAM].getValue())) {
 				if (nearestIndex >= 0) {
-					int32_t nearestTimestamp = keyframer.keyframe(nearestIndex).timestamp;
-					keyframer.RemoveKeyframe(nearestTimestamp);
+					keyframes.erase(keyframes.begin() + nearestIndex);
+					nearestIndex = findNearestKeyframe(timestamp, 2048);
+					keyframesChanged = true;
+					windowDirty = true;
 				}
 			}
-			keyframer.Evaluate(timestampMod);
 		}
 
 		// Get gains
-		float gains[4];
-		for (int i = 0; i < 4; i++) {
-			if (poly_lfo_mode) {
-				// gains[i] = poly_lfo.level(i) / 255.0;
-				gains[i] = poly_lfo.level16(i) / 65535.0;
-			}
-			else {
-				float lin = keyframer.level(i) / 65535.0;
-				gains[i] = lin;
+		if (poly_lfo_mode || keyframesChanged || timestampMod != lastTimestampMod) {
+			if (!poly_lfo_mode) {
+				loadWindow(timestampMod);
+				if (keyframes.empty()) {
+					// Without keyframes the knobs set the gains directly
+					for (int i = 0; i < 4; i++) {
+						keyframer.set_immediate(i, controls[i]);
+					}
+				}
+				keyframer.Evaluate(timestampMod);
 			}
-			// Simulate SSM2164
-			if (keyframer.mutable_settings(i)->response > 0) {
-				const float expBase = 200.0;
-				float expGain = rescale(powf(expBase, gains[i]), 1.0f, expBase, 0.0f, 1.0f);
-				gains[i] = crossfade(gains[i], expGain, keyframer.mutable_settings(i)->response / 255.0f);
+
+			for (int i = 0; i < 4; i++) {
+				if (poly_lfo_mode) {
+					// gains[i] = poly_lfo.level(i) / 255.0;
+					gains[i] = poly_lfo.level16(i) / 65535.0;
+				}
+				else {
+					float lin = keyframer.level(i) / 65535.0;
+					gains[i] = lin;
+				}
+				// Simulate SSM2164
+				if (keyframer.mutable_settings(i)->response > 0) {
+					float expGain = expResponse(gains[i]);
+					gains[i] = crossfade(gains[i], expGain, keyframer.mutable_settings(i)->response / 255.0f);
+				}
 			}
 		}
+		lastTimestamp = timestamp;
+		lastTimestampMod = timestampMod;
 
 		// Update last controls
 		for (int i = 0; i < 4; i++) {
@@ -189,29 +260,105 @@ struct Frames : Module {
 		outputs[MIX_OUTPUT].setVoltage(clamp(mix / 2.0, -10.0f, 10.0f));
 
 		// Set lights
-		for (int i = 0; i < 4; i++) {
-			lights[GAIN1_LIGHT + i].setBrightness(gains[i]);
+		if (lightDivider.process()) {
+			for (int i = 0; i < 4; i++) {
+				lights[GAIN1_LIGHT + i].setBrightness(gains[i]);
+			}
+
+			if (poly_lfo_mode) {
+				lights[EDIT_LIGHT].value = (poly_lfo.level(0) > 128 ? 1.0 : 0.0);
+			}
+			else {
+				lights[EDIT_LIGHT].value = (nearestIndex >= 0 ? 1.0 : 0.0);
+			}
+
+			// Set frame light colors
+			const uint8_t* colors;
+			if (poly_lfo_mode) {
+				colors = poly_lfo.color();
+			}
+			else {
+				colors = keyframer.color();
+			}
+			for (int i = 0; i < 3; i++) {
+				float c = colors[i] / 255.f;
+				// c = 1.f - (1.f - c) * 1.25f;
+				lights[FRAME_LIGHT + i].setBrightness(c);
+			}
 		}
+	}
 
-		if (poly_lfo_mode) {
-			lights[EDIT_LIGHT].value = (poly_lfo.level(0) > 128 ? 1.0 : 0.0);
+	/** Returns the index of the first keyframe at or after `timestamp`. */
+	int findKeyframe(int32_t timestamp) {
+		auto it = std::lower_bound(keyframes.begin(), keyframes.end(), timestamp, [](const StoredKeyframe& keyframe, int32_t timestamp) {
+			return keyframe.timestamp < timestamp;
+		});
+		return it - keyframes.begin();
+	}
+
+	/** Returns the index of the keyframe closest to `timestamp` within `tolerance`, or -1 if there is none. */
+	int findNearestKeyframe(int32_t timestamp, int32_t tolerance) {
+		int index = findKeyframe(timestamp);
+		int nearest = -1;
+		int32_t nearestDistance = tolerance;
+		for (int i = index - 1; i <= index; i++) {
+			if (i < 0 || i >= (int) keyframes.size())
+				continue;
+			int32_t distance = std::abs(keyframes[i].timestamp - timestamp);
+			if (distance < nearestDistance) {
+				nearest = i;
+				nearestDistance = distance;
+			}
 		}
-		else {
-			lights[EDIT_LIGHT].value = (nearestIndex >= 0 ? 1.0 : 0.0);
+		return nearest;
+	}
+
+	/** Inserts a keyframe, replacing the values of an existing keyframe with the same timestamp. */
+	bool addKeyframe(uint16_t timestamp, const uint16_t values[4]) {
+		int index = findKeyframe(timestamp);
+		if (index < (int) keyframes.size() && keyframes[index].timestamp == timestamp) {
+			std::copy(values, values + 4, keyframes[index].values);
+			return true;
 		}
+		if ((int) keyframes.size() >= MAX_KEYFRAMES)
+			return false;
+		StoredKeyframe keyframe;
+		keyframe.timestamp = timestamp;
+		std::copy(values, values + 4, keyframe.values);
+		keyframes.insert(keyframes.begin() + index, keyframe);
+		return true;
+	}
 
-		// Set frame light colors
-		const uint8_t* colors;
-		if (poly_lfo_mode) {
-			colors = poly_lfo.color();
+	/** Pages the keyframes surrounding `timestamp` into the keyframer if the current window doesn't already bracket it. */
+	void loadWindow(int32_t timestamp) {
+		int numKeyframes = keyframes.size();
+		int index = findKeyframe(timestamp);
+		if (!windowDirty) {
+			// The window must contain the keyframes on both sides of the timestamp, unless the timestamp is beyond the first or last keyframe.
+			bool coversStart = (windowStart == 0 || index > windowStart);
+			bool coversEnd = (windowEnd == numKeyframes || index < windowEnd);
+			if (coversStart && coversEnd)
+				return;
 		}
-		else {
-			colors = keyframer.color();
+		windowDirty = false;
+
+		windowStart = clamp(index - KEYFRAMER_WINDOW / 2, 0, std::max(numKeyframes - KEYFRAMER_WINDOW, 0));
+		windowEnd = std::min(windowStart + KEYFRAMER_WINDOW, numKeyframes);
+
+		// Clearing the keyframer shouldn't lose the per-channel settings
+		frames::EasingCurve curves[4];
+		int responses[4];
+		for (int i = 0; i < 4; i++) {
+			curves[i] = keyframer.mutable_settings(i)->easing_curve;
+			responses[i] = keyframer.mutable_settings(i)->response;
 		}
-		for (int i = 0; i < 3; i++) {
-			float c = colors[i] / 255.f;
-			// c = 1.f - (1.f - c) * 1.25f;
-			lights[FRAME_LIGHT + i].setBrightness(c);
+		keyframer.Clear();
+		for (int i = 0; i < 4; i++) {
+			keyframer.mutable_settings(i)->easing_curve = curves[i];
+			keyframer.mutable_settings(i)->response = responses[i];
+		}
+		for (int i = windowStart; i < windowEnd; i++) {
+			keyframer.AddKeyframe(keyframes[i].timestamp, keyframes[i].values);
 		}
 	}
 
@@ -219,17 +366,31 @@ struct Frames : Module {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "polyLfo", json_boolean(poly_lfo_mode));
 
-		json_t* keyframesJ = json_array();
-		for (int i = 0; i < keyframer.num_keyframes(); i++) {
-			json_t* keyframeJ = json_array();
-			frames::Keyframe* keyframe = keyframer.mutable_keyframe(i);
-			json_array_append_new(keyframeJ, json_integer(keyframe->timestamp));
-			for (int k = 0; k < 4; k++) {
-				json_array_append_new(keyframeJ, json_integer(keyframe->values[k]));
+		// Keyframes are stored as little-endian uint16 records of timestamp and 4 values
+		std::vector<uint8_t> keyframesData;
+		keyframesData.reserve(keyframes.size() * 10);
+		for (const StoredKeyframe& keyframe : keyframes) {
+			uint16_t words[5] = {keyframe.timestamp, keyframe.values[0], keyframe.values[1], keyframe.values[2], keyframe.values[3]};
+			for (uint16_t word : words) {
+				keyframesData.push_back(word & 0xff);
+				keyframesData.push_back(word >> 8);
 			}
-			json_array_append_new(keyframesJ, keyframeJ);
 		}
-		json_object_set_new(rootJ, "keyframes", keyframesJ);
+		json_object_set_new(rootJ, "keyframesData", json_string(string::toBase64(keyframesData.data(), keyframesData.size()).c_str()));
+
+		// Also write the legacy array while it fits the firmware's keyframe limit, so earlier versions can still load the patch
+		if (keyframes.size() <= (size_t) frames::kMaxNumKeyframe) {
+			json_t* keyframesJ = json_array();
+			for (const StoredKeyframe& keyframe : keyframes) {
+				json_t* keyframeJ = json_array();
+				json_array_append_new(keyframeJ, json_integer(keyframe.timestamp));
+				for (int k = 0; k < 4; k++) {
+					json_array_append_new(keyframeJ, json_integer(keyframe.values[k]));
+				}
+				json_array_append_new(keyframesJ, keyframeJ);
+			}
+			json_object_set_new(rootJ, "keyframes", keyframesJ);
+		}
 
 		json_t* channelsJ = json_array();
 		for (int i = 0; i < 4; i++) {
@@ -248,8 +409,24 @@ struct Frames : Module {
 		if (polyLfoJ)
 			poly_lfo_mode = json_boolean_value(polyLfoJ);
 
+		json_t* keyframesDataJ = json_object_get(rootJ, "keyframesData");
 		json_t* keyframesJ = json_object_get(rootJ, "keyframes");
-		if (keyframesJ) {
+		if (keyframesDataJ || keyframesJ)
+			keyframes.clear();
+
+		if (keyframesDataJ) {
+			std::vector<uint8_t> keyframesData = string::fromBase64(json_string_value(keyframesDataJ));
+			for (size_t i = 0; i + 10 <= keyframesData.size(); i += 10) {
+				uint16_t words[5];
+				for (int k = 0; k < 5; k++) {
+					words[k] = keyframesData[i + 2 * k] | (keyframesData[i + 2 * k + 1] << 8);
+				}
+				addKeyframe(words[0], &words[1]);
+			}
+		}
+
+		// Legacy, also written alongside keyframesData for earlier versions
+		if (keyframesJ && !keyframesDataJ) {
 			json_t* keyframeJ;
 			size_t i;
 			json_array_foreach(keyframesJ, i, keyframeJ) {
@@ -258,9 +435,10 @@ struct Frames : Module {
 				for (int k = 0; k < 4; k++) {
 					values[k] = json_integer_value(json_array_get(keyframeJ, k + 1));
 				}
-				keyframer.AddKeyframe(timestamp, values);
+				addKeyframe(timestamp, values);
 			}
 		}
+		keyframerDirty = true;
 
 		json_t* channelsJ = json_object_get(rootJ, "channels");
 		if (channelsJ) {
@@ -280,11 +458,13 @@ struct Frames : Module {
 
 	void onReset() override {
 		poly_lfo_mode = false;
+		keyframes.clear();
 		keyframer.Clear();
 		for (int i = 0; i < 4; i++) {
 			keyframer.mutable_settings(i)->easing_curve = frames::EASING_CURVE_LINEAR;
 			keyframer.mutable_settings(i)->response = 0;
 		}
+		keyframerDirty = true;
 	}
 	void onRandomize() override {
 		// TODO
@@ -368,7 +548,10 @@ struct FramesWidget : ModuleWidget {
 					for (int i = 0; i < (int) curveLabels.size(); i++) {
 						menu->addChild(createCheckMenuItem(curveLabels[i], "",
 							[=]() {return module->keyframer.mutable_settings(c)->easing_curve == i;},
-							[=]() {module->keyframer.mutable_settings(c)->easing_curve = (frames::EasingCurve) i;}
+							[=]() {
+								module->keyframer.mutable_settings(c)->easing_curve = (frames::EasingCurve) i;
+								module->keyframerDirty = true;
+							}
 						));
 					}
 
@@ -378,18 +561,26 @@ struct FramesWidget : ModuleWidget {
 
 					menu->addChild(createCheckMenuItem("Linear", "",
 						[=]() {return module->keyframer.mutable_settings(c)->response == 0;},
-						[=]() {module->keyframer.mutable_settings(c)->response = 0;}
+						[=]() {
+							module->keyframer.mutable_settings(c)->response = 0;
+							module->keyframerDirty = true;
+						}
 					));
 					menu->addChild(createCheckMenuItem("Exponential", "",
 						[=]() {return module->keyframer.mutable_settings(c)->response == 255;},
-						[=]() {module->keyframer.mutable_settings(c)->response = 255;}
+						[=]() {
+							module->keyframer.mutable_settings(c)->response = 255;
+							module->keyframerDirty = true;
+						}
 					));
 				}
 			));
 		}
 
 		menu->addChild(createMenuItem("Clear keyframes", "",
-			[=]() {module->keyframer.Clear();}
+			[=]() {
+				module->clearRequested = true;
+			}
 		));
 
 		menu->addChild(new MenuSeparator);
@@ -402,9 +593,14 @@ struct FramesWidget : ModuleWidget {
 		for (int i = 0; i < (int) modeLabels.size(); i++) {
 			menu->addChild(createCheckMenuItem(modeLabels[i], "",
 				[=]() {return module->poly_lfo_mode == i;},
-				[=]() {module->poly_lfo_mode = i;}
+				[=]() {
+					module->poly_lfo_mode = i;
+					module->keyframerDirty = true;
+				}
 			));
 		}
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
@@ -30,8 +30,11 @@ struct Kinks : Module {
 		NUM_LIGHTS
 	};
 
-	dsp::SchmittTrigger trigger;
-	float sample = 0.0;
+	dsp::TSchmittTrigger<simd::float_4> trigger[4];
+	simd::float_4 sample[4] = {};
+	LightDivider lightDivider;
+
+	Profiler profiler{"Kinks", {"Process"}};
 
 	Kinks() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -52,31 +55,63 @@ struct Kinks : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
-		// Gaussian noise generator
-		float noise = 2.0 * random::normal();
+		PROFILE_SCOPE(profiler, 0);
+
+		// Sign
+		int signChannels = std::max(inputs[SIGN_INPUT].getChannels(), 1);
+		for (int c = 0; c < signChannels; c += 4) {
+			simd::float_4 in = inputs[SIGN_INPUT].getVoltageSimd<simd::float_4>(c);
+			outputs[INVERT_OUTPUT].setVoltageSimd(-in, c);
+			outputs[HALF_RECTIFY_OUTPUT].setVoltageSimd(simd::fmax(0.f, in), c);
+			outputs[FULL_RECTIFY_OUTPUT].setVoltageSimd(simd::fabs(in), c);
+		}
+		outputs[INVERT_OUTPUT].setChannels(signChannels);
+		outputs[HALF_RECTIFY_OUTPUT].setChannels(signChannels);
+		outputs[FULL_RECTIFY_OUTPUT].setChannels(signChannels);
+
+		// Logic
+		int logicChannels = std::max({inputs[LOGIC_A_INPUT].getChannels(), inputs[LOGIC_B_INPUT].getChannels(), 1});
+		for (int c = 0; c < logicChannels; c += 4) {
+			simd::float_4 a = inputs[LOGIC_A_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+			simd::float_4 b = inputs[LOGIC_B_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+			outputs[MAX_OUTPUT].setVoltageSimd(simd::fmax(a, b), c);
+			outputs[MIN_OUTPUT].setVoltageSimd(simd::fmin(a, b), c);
+		}
+		outputs[MAX_OUTPUT].setChannels(logicChannels);
+		outputs[MIN_OUTPUT].setChannels(logicChannels);
 
 		// S&H
-		if (trigger.process(inputs[TRIG_INPUT].getVoltage() / 0.7)) {
-			sample = inputs[SH_INPUT].getNormalVoltage(noise);
+		int shChannels = std::max({inputs[SH_INPUT].getChannels(), inputs[TRIG_INPUT].getChannels(), 1});
+		bool shConnected = inputs[SH_INPUT].isConnected();
+		for (int c = 0; c < shChannels; c += 4) {
+			// Gaussian noise generator
+			simd::float_4 noise = 0.f;
+			for (int i = 0; i < 4 && c + i < shChannels; i++) {
+				noise[i] = 2.0 * random::normal();
+			}
+
+			simd::float_4 triggered = trigger[c / 4].process(inputs[TRIG_INPUT].getPolyVoltageSimd<simd::float_4>(c) / 0.7f);
+			simd::float_4 in = shConnected ? inputs[SH_INPUT].getPolyVoltageSimd<simd::float_4>(c) : noise;
+			sample[c / 4] = simd::ifelse(triggered, in, sample[c / 4]);
+
+			outputs[NOISE_OUTPUT].setVoltageSimd(noise, c);
+			outputs[SH_OUTPUT].setVoltageSimd(sample[c / 4], c);
 		}
+		outputs[NOISE_OUTPUT].setChannels(shChannels);
+		outputs[SH_OUTPUT].setChannels(shChannels);
 
 		// lights
-		lights[SIGN_POS_LIGHT].setSmoothBrightness(fmaxf(0.0, inputs[SIGN_INPUT].getVoltage() / 5.0), args.sampleTime);
-		lights[SIGN_NEG_LIGHT].setSmoothBrightness(fmaxf(0.0, -inputs[SIGN_INPUT].getVoltage() / 5.0), args.sampleTime);
-		float logicSum = inputs[LOGIC_A_INPUT].getVoltage() + inputs[LOGIC_B_INPUT].getVoltage();
-		lights[LOGIC_POS_LIGHT].setSmoothBrightness(fmaxf(0.0, logicSum / 5.0), args.sampleTime);
-		lights[LOGIC_NEG_LIGHT].setSmoothBrightness(fmaxf(0.0, -logicSum / 5.0), args.sampleTime);
-		lights[SH_POS_LIGHT].setBrightness(fmaxf(0.0, sample / 5.0));
-		lights[SH_NEG_LIGHT].setBrightness(fmaxf(0.0, -sample / 5.0));
-
-		// outputs
-		outputs[INVERT_OUTPUT].setVoltage(-inputs[SIGN_INPUT].getVoltage());
-		outputs[HALF_RECTIFY_OUTPUT].setVoltage(fmaxf(0.0, inputs[SIGN_INPUT].getVoltage()));
-		outputs[FULL_RECTIFY_OUTPUT].setVoltage(fabsf(inputs[SIGN_INPUT].getVoltage()));
-		outputs[MAX_OUTPUT].setVoltage(fmaxf(inputs[LOGIC_A_INPUT].getVoltage(), inputs[LOGIC_B_INPUT].getVoltage()));
-		outputs[MIN_OUTPUT].setVoltage(fminf(inputs[LOGIC_A_INPUT].getVoltage(), inputs[LOGIC_B_INPUT].getVoltage()));
-		outputs[NOISE_OUTPUT].setVoltage(noise);
-		outputs[SH_OUTPUT].setVoltage(sample);
+		if (lightDivider.process()) {
+			float lightTime = lightDivider.getSampleTime(args);
+			float sign = inputs[SIGN_INPUT].getVoltage();
+			lights[SIGN_POS_LIGHT].setSmoothBrightness(fmaxf(0.0, sign / 5.0), lightTime);
+			lights[SIGN_NEG_LIGHT].setSmoothBrightness(fmaxf(0.0, -sign / 5.0), lightTime);
+			float logicSum = inputs[LOGIC_A_INPUT].getVoltage() + inputs[LOGIC_B_INPUT].getVoltage();
+			lights[LOGIC_POS_LIGHT].setSmoothBrightness(fmaxf(0.0, logicSum / 5.0), lightTime);
+			lights[LOGIC_NEG_LIGHT].setSmoothBrightness(fmaxf(0.0, -logicSum / 5.0), lightTime);
+			lights[SH_POS_LIGHT].setBrightness(fmaxf(0.0, sample[0][0] / 5.0));
+			lights[SH_NEG_LIGHT].setBrightness(fmaxf(0.0, -sample[0][0] / 5.0));
+		}
 	}
 };
 
@@ -108,6 +143,11 @@ struct KinksWidget : ModuleWidget {
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(11, 161), module, Kinks::LOGIC_POS_LIGHT));
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(11, 262), module, Kinks::SH_POS_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Kinks* module = dynamic_cast<Kinks*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
@@ -30,6 +30,10 @@ struct Links : Module {
 		NUM_LIGHTS
 	};
 
+	LightDivider lightDivider;
+
+	Profiler profiler{"Links", {"Process"}};
+
 	Links() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configInput(A1_INPUT, "A1");
@@ -47,49 +51,60 @@ struct Links : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
+		bool updateLights = lightDivider.process();
+		float lightTime = lightDivider.getSampleTime(args);
+
 		// Section A
 		{
 			int channels = std::max(inputs[A1_INPUT].getChannels(), 1);
-			float in[16];
-			for (int c = 0; c < channels; c++) {
-				in[c] = inputs[A1_INPUT].getVoltage(c);
-				outputs[A1_OUTPUT].setVoltage(in[c], c);
-				outputs[A2_OUTPUT].setVoltage(in[c], c);
-				outputs[A3_OUTPUT].setVoltage(in[c], c);
+			simd::float_4 in[4];
+			for (int c = 0; c < channels; c += 4) {
+				in[c / 4] = inputs[A1_INPUT].getVoltageSimd<simd::float_4>(c);
+				outputs[A1_OUTPUT].setVoltageSimd(in[c / 4], c);
+				outputs[A2_OUTPUT].setVoltageSimd(in[c / 4], c);
+				outputs[A3_OUTPUT].setVoltageSimd(in[c / 4], c);
 			}
 			outputs[A1_OUTPUT].setChannels(channels);
 			outputs[A2_OUTPUT].setChannels(channels);
 			outputs[A3_OUTPUT].setChannels(channels);
-			lights[A_LIGHT + 0].setSmoothBrightness(in[0] / 5.f, args.sampleTime);
-			lights[A_LIGHT + 1].setSmoothBrightness(-in[0] / 5.f, args.sampleTime);
+			if (updateLights) {
+				lights[A_LIGHT + 0].setSmoothBrightness(in[0][0] / 5.f, lightTime);
+				lights[A_LIGHT + 1].setSmoothBrightness(-in[0][0] / 5.f, lightTime);
+			}
 		}
 
 		// Section B
 		{
-			int channels = std::max(std::max(inputs[B1_INPUT].getChannels(), inputs[B2_INPUT].getChannels()), 1);
-			float in[16];
-			for (int c = 0; c < channels; c++) {
-				in[c] = inputs[B1_INPUT].getPolyVoltage(c) + inputs[B2_INPUT].getPolyVoltage(c);
-				outputs[B1_OUTPUT].setVoltage(in[c], c);
-				outputs[B2_OUTPUT].setVoltage(in[c], c);
+			int channels = std::max({inputs[B1_INPUT].getChannels(), inputs[B2_INPUT].getChannels(), 1});
+			simd::float_4 in[4];
+			for (int c = 0; c < channels; c += 4) {
+				in[c / 4] = inputs[B1_INPUT].getPolyVoltageSimd<simd::float_4>(c) + inputs[B2_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+				outputs[B1_OUTPUT].setVoltageSimd(in[c / 4], c);
+				outputs[B2_OUTPUT].setVoltageSimd(in[c / 4], c);
 			}
 			outputs[B1_OUTPUT].setChannels(channels);
 			outputs[B2_OUTPUT].setChannels(channels);
-			lights[B_LIGHT + 0].setSmoothBrightness(in[0] / 5.f, args.sampleTime);
-			lights[B_LIGHT + 1].setSmoothBrightness(-in[0] / 5.f, args.sampleTime);
+			if (updateLights) {
+				lights[B_LIGHT + 0].setSmoothBrightness(in[0][0] / 5.f, lightTime);
+				lights[B_LIGHT + 1].setSmoothBrightness(-in[0][0] / 5.f, lightTime);
+			}
 		}
 
 		// Section C
 		{
-			int channels = std::max(std::max(std::max(inputs[C1_INPUT].getChannels(), inputs[C2_INPUT].getChannels()), inputs[C3_INPUT].getChannels()), 1);
-			float in[16];
-			for (int c = 0; c < channels; c++) {
-				in[c] = inputs[C1_INPUT].getPolyVoltage(c) + inputs[C2_INPUT].getPolyVoltage(c) + inputs[C3_INPUT].getPolyVoltage(c);
-				outputs[C1_OUTPUT].setVoltage(in[c], c);
+			int channels = std::max({inputs[C1_INPUT].getChannels(), inputs[C2_INPUT].getChannels(), inputs[C3_INPUT].getChannels(), 1});
+			simd::float_4 in[4];
+			for (int c = 0; c < channels; c += 4) {
+				in[c / 4] = inputs[C1_INPUT].getPolyVoltageSimd<simd::float_4>(c) + inputs[C2_INPUT].getPolyVoltageSimd<simd::float_4>(c) + inputs[C3_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+				outputs[C1_OUTPUT].setVoltageSimd(in[c / 4], c);
 			}
 			outputs[C1_OUTPUT].setChannels(channels);
-			lights[C_LIGHT + 0].setSmoothBrightness(in[0] / 5.f, args.sampleTime);
-			lights[C_LIGHT + 1].setSmoothBrightness(-in[0] / 5.f, args.sampleTime);
+			if (updateLights) {
+				lights[C_LIGHT + 0].setSmoothBrightness(in[0][0] / 5.f, lightTime);
+				lights[C_LIGHT + 1].setSmoothBrightness(-in[0][0] / 5.f, lightTime);
+			}
 		}
 	}
 };
@@ -122,6 +137,11 @@ struct LinksWidget : ModuleWidget {
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(26, 161), module, Links::B_LIGHT));
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(26, 262), module, Links::C_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Links* module = dynamic_cast<Links*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
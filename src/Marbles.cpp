@@ -222,6 +222,11 @@ struct Marbles : Module {
 	bool gates[BLOCK_SIZE * 2] = {};
 	float voltages[BLOCK_SIZE * 4] = {};
 	int blockIndex = 0;
+	// Gates seen since the last light update, so short gates still flash the lights
+	bool lightGates[2] = {};
+	LightDivider lightDivider;
+
+	Profiler profiler{"Marbles", {"Process"}};
 
 	Marbles() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -357,6 +362,8 @@ struct Marbles : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// Buttons
 		if (tDejaVuTrigger.process(params[T_DEJA_VU_PARAM].getValue() <= 0.f)) {
 			t_deja_vu = !t_deja_vu;
@@ -395,41 +402,51 @@ struct Marbles : Module {
 			stepBlock();
 		}
 
-		// Lights and outputs
-
-		lights[T_DEJA_VU_LIGHT].setBrightness(t_deja_vu);
-		lights[X_DEJA_VU_LIGHT].setBrightness(x_deja_vu);
-
-		int t_mode3 = t_mode % 3;
-		lights[T_MODE_LIGHTS + 0].setBrightness(t_mode3 == 0 || t_mode3 == 1);
-		lights[T_MODE_LIGHTS + 1].setBrightness(t_mode3 == 1 || t_mode3 == 2);
-
-		lights[X_MODE_LIGHTS + 0].setBrightness(x_mode == 0 || x_mode == 1);
-		lights[X_MODE_LIGHTS + 1].setBrightness(x_mode == 1 || x_mode == 2);
-
-		lights[T_RANGE_LIGHTS + 0].setBrightness(t_range == 0 || t_range == 1);
-		lights[T_RANGE_LIGHTS + 1].setBrightness(t_range == 1 || t_range == 2);
-
-		lights[X_RANGE_LIGHTS + 0].setBrightness(x_range == 0 || x_range == 1);
-		lights[X_RANGE_LIGHTS + 1].setBrightness(x_range == 1 || x_range == 2);
-
-		lights[EXTERNAL_LIGHT].setBrightness(external);
-
+		// Outputs
 		outputs[T1_OUTPUT].setVoltage(gates[blockIndex * 2 + 0] ? 10.f : 0.f);
-		lights[T1_LIGHT].setSmoothBrightness(gates[blockIndex * 2 + 0], args.sampleTime);
 		outputs[T2_OUTPUT].setVoltage((ramp_master[blockIndex] < 0.5f) ? 10.f : 0.f);
-		lights[T2_LIGHT].setSmoothBrightness(ramp_master[blockIndex] < 0.5f, args.sampleTime);
 		outputs[T3_OUTPUT].setVoltage(gates[blockIndex * 2 + 1] ? 10.f : 0.f);
-		lights[T3_LIGHT].setSmoothBrightness(gates[blockIndex * 2 + 1], args.sampleTime);
 
 		outputs[X1_OUTPUT].setVoltage(voltages[blockIndex * 4 + 0]);
-		lights[X1_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 0], args.sampleTime);
 		outputs[X2_OUTPUT].setVoltage(voltages[blockIndex * 4 + 1]);
-		lights[X2_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 1], args.sampleTime);
 		outputs[X3_OUTPUT].setVoltage(voltages[blockIndex * 4 + 2]);
-		lights[X3_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 2], args.sampleTime);
 		outputs[Y_OUTPUT].setVoltage(voltages[blockIndex * 4 + 3]);
-		lights[Y_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 3], args.sampleTime);
+
+		// Lights
+		lightGates[0] |= gates[blockIndex * 2 + 0];
+		lightGates[1] |= gates[blockIndex * 2 + 1];
+		if (lightDivider.process()) {
+			float lightTime = lightDivider.getSampleTime(args);
+
+			lights[T_DEJA_VU_LIGHT].setBrightness(t_deja_vu);
+			lights[X_DEJA_VU_LIGHT].setBrightness(x_deja_vu);
+
+			int t_mode3 = t_mode % 3;
+			lights[T_MODE_LIGHTS + 0].setBrightness(t_mode3 == 0 || t_mode3 == 1);
+			lights[T_MODE_LIGHTS + 1].setBrightness(t_mode3 == 1 || t_mode3 == 2);
+
+			lights[X_MODE_LIGHTS + 0].setBrightness(x_mode == 0 || x_mode == 1);
+			lights[X_MODE_LIGHTS + 1].setBrightness(x_mode == 1 || x_mode == 2);
+
+			lights[T_RANGE_LIGHTS + 0].setBrightness(t_range == 0 || t_range == 1);
+			lights[T_RANGE_LIGHTS + 1].setBrightness(t_range == 1 || t_range == 2);
+
+			lights[X_RANGE_LIGHTS + 0].setBrightness(x_range == 0 || x_range == 1);
+			lights[X_RANGE_LIGHTS + 1].setBrightness(x_range == 1 || x_range == 2);
+
+			lights[EXTERNAL_LIGHT].setBrightness(external);
+
+			lights[T1_LIGHT].setSmoothBrightness(lightGates[0], lightTime);
+			lights[T2_LIGHT].setSmoothBrightness(ramp_master[blockIndex] < 0.5f, lightTime);
+			lights[T3_LIGHT].setSmoothBrightness(lightGates[1], lightTime);
+			lightGates[0] = false;
+			lightGates[1] = false;
+
+			lights[X1_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 0], lightTime);
+			lights[X2_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 1], lightTime);
+			lights[X3_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 2], lightTime);
+			lights[Y_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 3], lightTime);
+		}
 	}
 
 	void stepBlock() {
@@ -667,6 +684,8 @@ struct MarblesWidget : ModuleWidget {
 			"1/2",
 			"1",
 		}, &module->y_divider_index));
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
@@ -44,18 +44,43 @@ struct Plaits : Module {
 		NUM_LIGHTS
 	};
 
-	plaits::Voice voice[16];
+	static const int SHARED_BUFFER_SIZE = 16384;
+	Arena arena{Arena::sizeOf<plaits::Voice>(16) + Arena::sizeOf<char>(16 * SHARED_BUFFER_SIZE)};
+	plaits::Voice* voice;
+	char* shared_buffer[16];
+	BackgroundInit backgroundInit;
 	plaits::Patch patch = {};
-	char shared_buffer[16][16384] = {};
 	float triPhase = 0.f;
 
+	// Idle voice tracking
+	bool sleeping[16] = {};
+	int silentFrames[16] = {};
+	/** Knobs and CV of each voice when it went to sleep */
+	plaits::Patch sleepPatch[16] = {};
+	plaits::Modulations sleepModulations[16] = {};
+
+	/** Highest TRIGGER voltage seen since the last block, so short pulses are not missed with blocks longer than the hardware's */
+	float triggerPeak[16] = {};
+
 	dsp::SampleRateConverter<16 * 2> outputSrc;
-	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
-	bool lowCpu = false;
+	// Large enough for the largest block upsampled to 192 kHz
+	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 1024> outputBuffer;
+
+	struct Settings {
+		bool lowCpu = false;
+		/** Number of 48 kHz frames rendered per block. One of 12, 24, 48, or 96. */
+		int blockSize = 12;
+	};
+	/** Context menu settings, applied at block boundaries */
+	SettingsBuffer<Settings> settings;
+	/** Whether the CPU governor may switch to low CPU mode */
+	bool governed = false;
 
 	dsp::BooleanTrigger model1Trigger;
 	dsp::BooleanTrigger model2Trigger;
 
+	Profiler profiler{"Plaits", {"Process", "Render", "SRC"}};
+
 	Plaits() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configButton(MODEL1_PARAM, "Pitched models");
@@ -82,12 +107,21 @@ struct Plaits : Module {
 		configOutput(OUT_OUTPUT, "Main");
 		configOutput(AUX_OUTPUT, "Auxiliary");
 
-		for (int i = 0; i < 16; i++) {
-			stmlib::BufferAllocator allocator(shared_buffer[i], sizeof(shared_buffer[i]));
-			voice[i].Init(&allocator);
-		}
+		backgroundInit.start([this]() {
+			// Voices are touched every block, so they go before the engines' shared buffers.
+			voice = arena.create<plaits::Voice>(16);
+			for (int i = 0; i < 16; i++) {
+				shared_buffer[i] = arena.create<char>(SHARED_BUFFER_SIZE);
+			}
+
+			for (int i = 0; i < 16; i++) {
+				stmlib::BufferAllocator allocator(shared_buffer[i], SHARED_BUFFER_SIZE);
+				voice[i].Init(&allocator);
+			}
+		});
 
 		onReset();
+		staggerBlocks(outputBuffer, settings.ui().blockSize * APP->engine->getSampleRate() / 48000);
 	}
 
 	void onReset() override {
@@ -103,8 +137,10 @@ struct Plaits : Module {
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 
-		json_object_set_new(rootJ, "lowCpu", json_boolean(lowCpu));
+		json_object_set_new(rootJ, "lowCpu", json_boolean(settings.ui().lowCpu));
+		json_object_set_new(rootJ, "blockSize", json_integer(settings.ui().blockSize));
 		json_object_set_new(rootJ, "model", json_integer(patch.engine));
+		json_object_set_new(rootJ, "governed", json_boolean(governed));
 
 		return rootJ;
 	}
@@ -112,12 +148,20 @@ struct Plaits : Module {
 	void dataFromJson(json_t* rootJ) override {
 		json_t* lowCpuJ = json_object_get(rootJ, "lowCpu");
 		if (lowCpuJ)
-			lowCpu = json_boolean_value(lowCpuJ);
+			setLowCpu(json_boolean_value(lowCpuJ));
+
+		json_t* blockSizeJ = json_object_get(rootJ, "blockSize");
+		if (blockSizeJ)
+			setBlockSize(json_integer_value(blockSizeJ));
 
 		json_t* modelJ = json_object_get(rootJ, "model");
 		if (modelJ)
 			patch.engine = json_integer_value(modelJ);
 
+		json_t* governedJ = json_object_get(rootJ, "governed");
+		if (governedJ)
+			governed = json_boolean_value(governedJ);
+
 		// Legacy <=1.0.2
 		json_t* lpgColorJ = json_object_get(rootJ, "lpgColor");
 		if (lpgColorJ)
@@ -129,11 +173,67 @@ struct Plaits : Module {
 			params[LPG_DECAY_PARAM].setValue(json_number_value(decayJ));
 	}
 
+	void setLowCpu(bool lowCpu) {
+		settings.ui().lowCpu = lowCpu;
+		settings.publish();
+	}
+
+	void setBlockSize(int blockSize) {
+		if (!(blockSize == 12 || blockSize == 24 || blockSize == 48 || blockSize == 96))
+			return;
+		settings.ui().blockSize = blockSize;
+		settings.publish();
+	}
+
+	/** Returns whether a knob or CV of a sleeping voice moved since it went to sleep.
+	Engines that skip the LPG, like the drums, can start sounding again without a trigger.
+	*/
+	bool isSleepInputChanged(int c, const plaits::Modulations& modulations) {
+		const plaits::Patch& p = sleepPatch[c];
+		const plaits::Modulations& m = sleepModulations[c];
+		auto moved = [](float a, float b) {
+			return std::fabs(a - b) > 0.01f;
+		};
+		return patch.engine != p.engine
+			|| moved(patch.note, p.note)
+			|| moved(patch.harmonics, p.harmonics)
+			|| moved(patch.timbre, p.timbre)
+			|| moved(patch.morph, p.morph)
+			|| moved(patch.lpg_colour, p.lpg_colour)
+			|| moved(patch.decay, p.decay)
+			|| moved(patch.frequency_modulation_amount, p.frequency_modulation_amount)
+			|| moved(patch.timbre_modulation_amount, p.timbre_modulation_amount)
+			|| moved(patch.morph_modulation_amount, p.morph_modulation_amount)
+			|| moved(modulations.engine, m.engine)
+			|| moved(modulations.note, m.note)
+			|| moved(modulations.frequency, m.frequency)
+			|| moved(modulations.harmonics, m.harmonics)
+			|| moved(modulations.timbre, m.timbre)
+			|| moved(modulations.morph, m.morph)
+			|| moved(modulations.level, m.level)
+			|| modulations.frequency_patched != m.frequency_patched
+			|| modulations.timbre_patched != m.timbre_patched
+			|| modulations.morph_patched != m.morph_patched
+			|| modulations.level_patched != m.level_patched;
+	}
+
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+		if (!backgroundInit.isReady())
+			return;
+
 		int channels = std::max(inputs[NOTE_INPUT].getChannels(), 1);
 
+		if (inputs[TRIGGER_INPUT].isConnected()) {
+			for (int c = 0; c < channels; c++) {
+				triggerPeak[c] = std::max(triggerPeak[c], inputs[TRIGGER_INPUT].getPolyVoltage(c));
+			}
+		}
+
 		if (outputBuffer.empty()) {
-			const int blockSize = 12;
+			settings.fetch();
+			const int blockSize = settings.engine().blockSize;
+			const bool lowCpu = settings.engine().lowCpu || (governed && getCpuGovernorLevel() >= 1);
 
 			// Model buttons
 			if (model1Trigger.process(params[MODEL1_PARAM].getValue())) {
@@ -197,7 +297,7 @@ struct Plaits : Module {
 			patch.morph_modulation_amount = params[MORPH_CV_PARAM].getValue();
 
 			// Render output buffer for each voice
-			dsp::Frame<16 * 2> outputFrames[blockSize];
+			dsp::Frame<16 * 2> outputFrames[96];
 			for (int c = 0; c < channels; c++) {
 				// Construct modulations
 				plaits::Modulations modulations;
@@ -208,7 +308,10 @@ struct Plaits : Module {
 				modulations.timbre = inputs[TIMBRE_INPUT].getPolyVoltage(c) / 8.f;
 				modulations.morph = inputs[MORPH_INPUT].getPolyVoltage(c) / 8.f;
 				// Triggers at around 0.7 V
-				modulations.trigger = inputs[TRIGGER_INPUT].getPolyVoltage(c) / 3.f;
+				// The hardware's 12-frame blocks sample TRIGGER once per block, so keep that detection at the default block size.
+				float trigger = (blockSize > 12) ? triggerPeak[c] : inputs[TRIGGER_INPUT].getPolyVoltage(c);
+				modulations.trigger = trigger / 3.f;
+				triggerPeak[c] = inputs[TRIGGER_INPUT].getPolyVoltage(c);
 				modulations.level = inputs[LEVEL_INPUT].getPolyVoltage(c) / 8.f;
 
 				modulations.frequency_patched = inputs[FREQ_INPUT].isConnected();
@@ -217,14 +320,56 @@ struct Plaits : Module {
 				modulations.trigger_patched = inputs[TRIGGER_INPUT].isConnected();
 				modulations.level_patched = inputs[LEVEL_INPUT].isConnected();
 
+				// Voices can only go silent for good while the LPG is closed, i.e. driven by TRIG, or by LEVEL held at zero.
+				bool lpgClosed = modulations.trigger_patched || (modulations.level_patched && modulations.level < 0.01f);
+				if (sleeping[c]) {
+					bool triggered = modulations.trigger_patched && modulations.trigger > 0.1f;
+					if (!lpgClosed || triggered || isSleepInputChanged(c, modulations)) {
+						// The voice went to sleep below the noise floor, so resuming it from its previous state does not click.
+						sleeping[c] = false;
+						silentFrames[c] = 0;
+					}
+				}
+
+				if (sleeping[c]) {
+					for (int i = 0; i < blockSize; i++) {
+						outputFrames[i].samples[c * 2 + 0] = 0.f;
+						outputFrames[i].samples[c * 2 + 1] = 0.f;
+					}
+					continue;
+				}
+
 				// Render frames
-				plaits::Voice::Frame output[blockSize];
-				voice[c].Render(patch, modulations, output, blockSize);
+				// Long blocks are rendered in chunks of the hardware's 12 frames, with the same patch and modulations.
+				plaits::Voice::Frame output[96];
+				{
+					PROFILE_SCOPE(profiler, 1);
+					for (int i = 0; i < blockSize; i += 12) {
+						voice[c].Render(patch, modulations, &output[i], 12);
+					}
+				}
 
 				// Convert output to frames
+				float energy = 0.f;
 				for (int i = 0; i < blockSize; i++) {
-					outputFrames[i].samples[c * 2 + 0] = output[i].out / 32768.f;
-					outputFrames[i].samples[c * 2 + 1] = output[i].aux / 32768.f;
+					float out = output[i].out;
+					float aux = output[i].aux;
+					outputFrames[i].samples[c * 2 + 0] = out / 32768.f;
+					outputFrames[i].samples[c * 2 + 1] = aux / 32768.f;
+					energy += out * out + aux * aux;
+				}
+
+				// Put the voice to sleep after about 0.5 seconds below -80 dBFS
+				if (lpgClosed && energy < 16.f * blockSize && modulations.trigger <= 0.1f) {
+					silentFrames[c] += blockSize;
+					if (silentFrames[c] >= 24000) {
+						sleeping[c] = true;
+						sleepPatch[c] = patch;
+						sleepModulations[c] = modulations;
+					}
+				}
+				else {
+					silentFrames[c] = 0;
 				}
 			}
 
@@ -235,6 +380,7 @@ struct Plaits : Module {
 				outputBuffer.endIncr(len);
 			}
 			else {
+				PROFILE_SCOPE(profiler, 2);
 				outputSrc.setRates(48000, (int) args.sampleRate);
 				int inLen = blockSize;
 				int outLen = outputBuffer.capacity();
@@ -330,12 +476,35 @@ struct PlaitsWidget : ModuleWidget {
 		addChild(createLight<MediumLight<GreenRedLight>>(mm2px(Vec(28.79498, 61.11827)), module, Plaits::MODEL_LIGHT + 7 * 2));
 	}
 
+	void step() override {
+		Plaits* module = dynamic_cast<Plaits*>(this->module);
+
+		if (module && module->governed)
+			stepCpuGovernor();
+
+		ModuleWidget::step();
+	}
+
 	void appendContextMenu(Menu* menu) override {
 		Plaits* module = dynamic_cast<Plaits*>(this->module);
 
 		menu->addChild(new MenuSeparator);
 
-		menu->addChild(createBoolPtrMenuItem("Low CPU (disable resampling)", "", &module->lowCpu));
+		menu->addChild(createBoolMenuItem("Low CPU (disable resampling)", "",
+			[=]() {return module->settings.ui().lowCpu;},
+			[=](bool val) {module->setLowCpu(val);}
+		));
+		appendCpuGovernorMenu(menu, &module->governed);
+
+		static const std::vector<int> blockSizes = {12, 24, 48, 96};
+		menu->addChild(createSubmenuItem("Block size", string::f("%d", module->settings.ui().blockSize), [=](Menu* menu) {
+			for (int blockSize : blockSizes) {
+				menu->addChild(createCheckMenuItem(string::f("%d (%g ms)", blockSize, blockSize / 48.f), "",
+					[=]() {return module->settings.ui().blockSize == blockSize;},
+					[=]() {module->setBlockSize(blockSize);}
+				));
+			}
+		}));
 
 		menu->addChild(createBoolMenuItem("Edit LPG response/decay", "",
 			[=]() {return this->getLpgMode();},
@@ -361,6 +530,8 @@ struct PlaitsWidget : ModuleWidget {
 				[=]() {module->patch.engine = i;}
 			));
 		}
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 
 	void setLpgMode(bool lpgMode) {
@@ -59,9 +59,19 @@ struct Rings : Module {
 
 	dsp::SchmittTrigger polyphonyTrigger;
 	dsp::SchmittTrigger modelTrigger;
+	LightDivider lightDivider;
 	int polyphonyMode = 0;
+	/** Whether the CPU governor may reduce polyphony */
+	bool governed = false;
 	rings::ResonatorModel resonatorModel = rings::RESONATOR_MODEL_MODAL;
-	bool easterEgg = false;
+
+	struct Settings {
+		bool easterEgg = false;
+	};
+	/** Context menu settings, applied at block boundaries */
+	SettingsBuffer<Settings> settings;
+
+	Profiler profiler{"Rings", {"Process", "Input SRC", "Part", "Output SRC"}};
 
 	Rings() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -96,9 +106,13 @@ struct Rings : Module {
 		strummer.Init(0.01, 44100.0 / 24);
 		part.Init(reverb_buffer);
 		string_synth.Init(reverb_buffer);
+
+		staggerBlocks(outputBuffer, 24 * APP->engine->getSampleRate() / 48000);
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// TODO
 		// "Normalized to a pulse/burst generator that reacts to note changes on the V/OCT input."
 		// Get input
@@ -116,21 +130,24 @@ struct Rings : Module {
 		if (polyphonyTrigger.process(params[POLYPHONY_PARAM].getValue())) {
 			polyphonyMode = (polyphonyMode + 1) % 3;
 		}
-		lights[POLYPHONY_GREEN_LIGHT].value = (polyphonyMode == 0 || polyphonyMode == 1) ? 1.0 : 0.0;
-		lights[POLYPHONY_RED_LIGHT].value = (polyphonyMode == 1 || polyphonyMode == 2) ? 1.0 : 0.0;
-
 		if (modelTrigger.process(params[RESONATOR_PARAM].getValue())) {
 			resonatorModel = (rings::ResonatorModel)((resonatorModel + 1) % 3);
 		}
-		int modelColor = resonatorModel % 3;
-		lights[RESONATOR_GREEN_LIGHT].value = (modelColor == 0 || modelColor == 1) ? 1.0 : 0.0;
-		lights[RESONATOR_RED_LIGHT].value = (modelColor == 1 || modelColor == 2) ? 1.0 : 0.0;
+
+		if (lightDivider.process()) {
+			lights[POLYPHONY_GREEN_LIGHT].value = (polyphonyMode == 0 || polyphonyMode == 1) ? 1.0 : 0.0;
+			lights[POLYPHONY_RED_LIGHT].value = (polyphonyMode == 1 || polyphonyMode == 2) ? 1.0 : 0.0;
+			int modelColor = resonatorModel % 3;
+			lights[RESONATOR_GREEN_LIGHT].value = (modelColor == 0 || modelColor == 1) ? 1.0 : 0.0;
+			lights[RESONATOR_RED_LIGHT].value = (modelColor == 1 || modelColor == 2) ? 1.0 : 0.0;
+		}
 
 		// Render frames
 		if (outputBuffer.empty()) {
 			float in[24] = {};
 			// Convert input buffer
 			{
+				PROFILE_SCOPE(profiler, 1);
 				inputSrc.setRates(args.sampleRate, 48000);
 				int inLen = inputBuffer.size();
 				int outLen = 24;
@@ -140,9 +157,13 @@ struct Rings : Module {
 
 			// Polyphony
 			int polyphony = 1 << polyphonyMode;
+			if (governed)
+				polyphony = std::min(polyphony, 4 >> getCpuGovernorLevel());
 			if (part.polyphony() != polyphony)
 				part.set_polyphony(polyphony);
 			// Model
+			settings.fetch();
+			bool easterEgg = settings.engine().easterEgg;
 			if (easterEgg)
 				string_synth.set_fx((rings::FxType) resonatorModel);
 			else
@@ -182,17 +203,22 @@ struct Rings : Module {
 			// Process audio
 			float out[24];
 			float aux[24];
-			if (easterEgg) {
-				strummer.Process(NULL, 24, &performance_state);
-				string_synth.Process(performance_state, patch, in, out, aux, 24);
-			}
-			else {
-				strummer.Process(in, 24, &performance_state);
-				part.Process(performance_state, patch, in, out, aux, 24);
+			{
+				PROFILE_SCOPE(profiler, 2);
+				DenormalGuard denormalGuard;
+				if (easterEgg) {
+					strummer.Process(NULL, 24, &performance_state);
+					string_synth.Process(performance_state, patch, in, out, aux, 24);
+				}
+				else {
+					strummer.Process(in, 24, &performance_state);
+					part.Process(performance_state, patch, in, out, aux, 24);
+				}
 			}
 
 			// Convert output buffer
 			{
+				PROFILE_SCOPE(profiler, 3);
 				dsp::Frame<2> outputFrames[24];
 				for (int i = 0; i < 24; i++) {
 					outputFrames[i].samples[0] = out[i];
@@ -228,7 +254,8 @@ struct Rings : Module {
 
 		json_object_set_new(rootJ, "polyphony", json_integer(polyphonyMode));
 		json_object_set_new(rootJ, "model", json_integer((int) resonatorModel));
-		json_object_set_new(rootJ, "easterEgg", json_boolean(easterEgg));
+		json_object_set_new(rootJ, "easterEgg", json_boolean(settings.ui().easterEgg));
+		json_object_set_new(rootJ, "governed", json_boolean(governed));
 
 		return rootJ;
 	}
@@ -246,10 +273,20 @@ struct Rings : Module {
 
 		json_t* easterEggJ = json_object_get(rootJ, "easterEgg");
 		if (easterEggJ) {
-			easterEgg = json_boolean_value(easterEggJ);
+			setEasterEgg(json_boolean_value(easterEggJ));
+		}
+
+		json_t* governedJ = json_object_get(rootJ, "governed");
+		if (governedJ) {
+			governed = json_boolean_value(governedJ);
 		}
 	}
 
+	void setEasterEgg(bool easterEgg) {
+		settings.ui().easterEgg = easterEgg;
+		settings.publish();
+	}
+
 	void onReset() override {
 		polyphonyMode = 0;
 		resonatorModel = rings::RESONATOR_MODEL_MODAL;
@@ -304,6 +341,15 @@ struct RingsWidget : ModuleWidget {
 		addChild(createLight<MediumLight<GreenRedLight>>(Vec(162, 43), module, Rings::RESONATOR_GREEN_LIGHT));
 	}
 
+	void step() override {
+		Rings* module = dynamic_cast<Rings*>(this->module);
+
+		if (module && module->governed)
+			stepCpuGovernor();
+
+		ModuleWidget::step();
+	}
+
 	void appendContextMenu(Menu* menu) override {
 		Rings* module = dynamic_cast<Rings*>(this->module);
 		assert(module);
@@ -330,9 +376,12 @@ struct RingsWidget : ModuleWidget {
 		menu->addChild(new MenuSeparator);
 
 		menu->addChild(createBoolMenuItem("Disastrous Peace", "",
-			[=]() {return module->easterEgg;},
-			[=](bool val) {module->easterEgg = val;}
+			[=]() {return module->settings.ui().easterEgg;},
+			[=](bool val) {module->setEasterEgg(val);}
 		));
+		appendCpuGovernorMenu(menu, &module->governed);
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
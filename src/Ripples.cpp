@@ -30,6 +30,8 @@ struct Ripples : Module {
 
 	ripples::RipplesEngine engines[16];
 
+	Profiler profiler{"Ripples", {"Process"}};
+
 	Ripples() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(RES_PARAM, 0.f, 1.f, 0.f, "Resonance", "%", 0, 100);
@@ -67,6 +69,9 @@ struct Ripples : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+		DenormalGuard denormalGuard;
+
 		int channels = std::max(inputs[IN_INPUT].getChannels(), 1);
 
 		// Reuse the same frame object for multiple engines because the params aren't touched.
@@ -122,6 +127,11 @@ struct RipplesWidget : ModuleWidget {
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(20.297, 111.05)), module, Ripples::LP4_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(32.367, 111.05)), module, Ripples::LP4VCA_OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Ripples* module = dynamic_cast<Ripples*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
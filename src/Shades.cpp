@@ -30,6 +30,10 @@ struct Shades : Module {
 		NUM_LIGHTS
 	};
 
+	LightDivider lightDivider;
+
+	Profiler profiler{"Shades", {"Process"}};
+
 	Shades() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		for (int c = 0; c < 3; c++) {
@@ -41,24 +45,49 @@ struct Shades : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
-		float out = 0.0;
+		PROFILE_SCOPE(profiler, 0);
+
+		simd::float_4 out[4] = {};
+		// Number of channels summed into `out` by the rows above
+		int carried = 1;
+		bool updateLights = lightDivider.process();
+		float lightTime = lightDivider.getSampleTime(args);
 
 		for (int i = 0; i < 3; i++) {
-			float in = inputs[IN1_INPUT + i].getNormalVoltage(5.0);
+			float gain = params[GAIN1_PARAM + i].getValue();
 			if ((int)params[MODE1_PARAM + i].getValue() == 1) {
 				// attenuverter
-				in *= 2.0 * params[GAIN1_PARAM + i].getValue() - 1.0;
+				gain = 2.0 * gain - 1.0;
 			}
-			else {
-				// attenuator
-				in *= params[GAIN1_PARAM + i].getValue();
+			bool inConnected = inputs[IN1_INPUT + i].isConnected();
+			int channels = std::max(carried, inputs[IN1_INPUT + i].getChannels());
+			// A mono sum carried from the rows above applies to every channel of a wider row
+			if (carried == 1) {
+				simd::float_4 mono = out[0][0];
+				for (int c = 0; c < channels; c += 4) {
+					out[c / 4] = mono;
+				}
+			}
+
+			for (int c = 0; c < channels; c += 4) {
+				simd::float_4 in = inConnected ? inputs[IN1_INPUT + i].getPolyVoltageSimd<simd::float_4>(c) : 5.f;
+				out[c / 4] += in * gain;
+			}
+
+			if (updateLights) {
+				lights[OUT1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, out[0][0] / 5.0), lightTime);
+				lights[OUT1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -out[0][0] / 5.0), lightTime);
 			}
-			out += in;
-			lights[OUT1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, out / 5.0), args.sampleTime);
-			lights[OUT1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -out / 5.0), args.sampleTime);
 			if (outputs[OUT1_OUTPUT + i].isConnected()) {
-				outputs[OUT1_OUTPUT + i].setVoltage(out);
-				out = 0.0;
+				outputs[OUT1_OUTPUT + i].setChannels(channels);
+				for (int c = 0; c < channels; c += 4) {
+					outputs[OUT1_OUTPUT + i].setVoltageSimd(out[c / 4], c);
+					out[c / 4] = 0.f;
+				}
+				carried = 1;
+			}
+			else {
+				carried = channels;
 			}
 		}
 	}
@@ -93,6 +122,11 @@ struct ShadesWidget : ModuleWidget {
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(41, 290), module, Shades::OUT2_POS_LIGHT));
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(41, 326), module, Shades::OUT3_POS_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Shades* module = dynamic_cast<Shades*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
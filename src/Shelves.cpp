@@ -60,6 +60,12 @@ struct Shelves : Module {
 	shelves::ShelvesEngine engines[16];
 	bool preGain;
 
+	// Clipping seen since the last light update
+	float clipLight = 0.f;
+	LightDivider lightDivider;
+
+	Profiler profiler{"Shelves", {"Process"}};
+
 	Shelves() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -116,6 +122,8 @@ struct Shelves : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		int channels = std::max(inputs[IN_INPUT].getChannels(), 1);
 
 		// Reuse the same frame object for multiple engines because the params aren't touched.
@@ -155,8 +163,7 @@ struct Shelves : Module {
 		frame.p2_bp_out_connected = outputs[P2_BP_OUTPUT].isConnected();
 		frame.p2_lp_out_connected = outputs[P2_LP_OUTPUT].isConnected();
 
-		float clipLight = 0.f;
-
+		float clip = 0.f;
 		for (int c = 0; c < channels; c++) {
 			frame.main_in = inputs[IN_INPUT].getVoltage(c);
 			frame.hs_freq_cv = inputs[HS_FREQ_INPUT].getPolyVoltage(c);
@@ -181,7 +188,7 @@ struct Shelves : Module {
 			outputs[P2_BP_OUTPUT].setVoltage(frame.p2_bp_out, c);
 			outputs[P2_LP_OUTPUT].setVoltage(frame.p2_lp_out, c);
 			outputs[OUT_OUTPUT].setVoltage(frame.main_out, c);
-			clipLight += frame.clip;
+			clip += frame.clip;
 		}
 
 		outputs[P1_HP_OUTPUT].setChannels(channels);
@@ -191,7 +198,12 @@ struct Shelves : Module {
 		outputs[P2_BP_OUTPUT].setChannels(channels);
 		outputs[P2_LP_OUTPUT].setChannels(channels);
 		outputs[OUT_OUTPUT].setChannels(channels);
-		lights[CLIP_LIGHT].setSmoothBrightness(clipLight, args.sampleTime);
+
+		clipLight = std::max(clipLight, clip);
+		if (lightDivider.process()) {
+			lights[CLIP_LIGHT].setSmoothBrightness(clipLight, lightDivider.getSampleTime(args));
+			clipLight = 0.f;
+		}
 	}
 
 	json_t* dataToJson() override {
@@ -260,6 +272,8 @@ struct ShelvesWidget : ModuleWidget {
 		menu->addChild(new MenuSeparator);
 
 		menu->addChild(createBoolPtrMenuItem("Pad input by -6dB", "", &module->preGain));
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
@@ -152,6 +152,9 @@ struct Stages : Module {
 	stmlib::GateFlags gate_flags[NUM_CHANNELS][BLOCK_SIZE] = {};
 	int blockIndex = 0;
 	GroupBuilder groupBuilder;
+	LightDivider lightDivider;
+
+	Profiler profiler{"Stages", {"Process"}};
 
 	Stages() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -320,6 +323,8 @@ struct Stages : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// Oscillate flashing the type lights
 		lightOscillatorPhase += 0.5f * args.sampleTime;
 		if (lightOscillatorPhase >= 1.0f)
@@ -349,6 +354,8 @@ struct Stages : Module {
 		}
 
 		// Output
+		bool updateLights = lightDivider.process();
+		float lightTime = lightDivider.getSampleTime(args);
 		for (int i = 0; i < groupBuilder.groupCount; i++) {
 			GroupInfo& group = groupBuilder.groups[i];
 
@@ -358,7 +365,10 @@ struct Stages : Module {
 
 				float envelope = envelopeBuffer[segment][blockIndex];
 				outputs[ENVELOPE_OUTPUTS + segment].setVoltage(envelope * 8.f);
-				lights[ENVELOPE_LIGHTS + segment].setSmoothBrightness(envelope, args.sampleTime);
+
+				if (!updateLights)
+					continue;
+				lights[ENVELOPE_LIGHTS + segment].setSmoothBrightness(envelope, lightTime);
 
 				numberOfLoopsInGroup += configurations[segment].loop ? 1 : 0;
 				float flashlevel = 1.f;
@@ -444,6 +454,11 @@ struct StagesWidget : ModuleWidget {
 		addChild(createLight<MediumLight<GreenLight>>(mm2px(Vec(48.07649, 103.19253)), module, Stages::ENVELOPE_LIGHTS + 4));
 		addChild(createLight<MediumLight<GreenLight>>(mm2px(Vec(59.51696, 103.19253)), module, Stages::ENVELOPE_LIGHTS + 5));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Stages* module = dynamic_cast<Stages*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
@@ -111,6 +111,8 @@ struct Streams : Module {
 	int prevNumChannels;
 	float brightnesses[NUM_LIGHTS][PORT_MAX_CHANNELS];
 
+	Profiler profiler{"Streams", {"Process"}};
+
 	Streams() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -262,6 +264,8 @@ struct Streams : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		int numChannels = std::max(inputs[CH1_SIGNAL_INPUT].getChannels(), inputs[CH2_SIGNAL_INPUT].getChannels());
 		numChannels = std::max(numChannels, 1);
 
@@ -424,6 +428,8 @@ struct StreamsWidget : ModuleWidget {
 			[=]() {return module->monitorMode();},
 			[=](int index) {module->setMonitorMode(index);}
 		));
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
@@ -44,12 +44,20 @@ struct Tides : Module {
 	};
 
 	bool sheep;
-	tides::Generator generator;
+	tides::Generator generators[16];
 	int frame = 0;
-	uint8_t lastGate;
+	int channels = 1;
+	uint8_t lastGates[16] = {};
+	/** Gate flags of the current block, exchanged with each voice's generator at the block boundary */
+	uint8_t gates[16][16] = {};
+	/** Samples played during the current block */
+	tides::GeneratorSample samples[16][16] = {};
+	LightDivider lightDivider;
 	dsp::SchmittTrigger modeTrigger;
 	dsp::SchmittTrigger rangeTrigger;
 
+	Profiler profiler{"Tides", {"Process", "Generator"}};
+
 	Tides() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configButton(MODE_PARAM, "Output mode");
@@ -75,115 +83,175 @@ struct Tides : Module {
 		configOutput(UNI_OUTPUT, "Unipolar");
 		configOutput(BI_OUTPUT, "Bipolar");
 
-		memset(&generator, 0, sizeof(generator));
-		generator.Init();
-		generator.set_sync(false);
+		for (int c = 0; c < 16; c++) {
+			memset(&generators[c], 0, sizeof(generators[c]));
+			generators[c].Init();
+			generators[c].set_sync(false);
+		}
 		onReset();
+		// Stagger block boundaries between instances
+		frame = (int) (nextBlockPhase() * 16);
+	}
+
+	void setMode(tides::GeneratorMode mode) {
+		for (int c = 0; c < 16; c++) {
+			generators[c].set_mode(mode);
+		}
+	}
+
+	void setRange(tides::GeneratorRange range) {
+		for (int c = 0; c < 16; c++) {
+			generators[c].set_range(range);
+		}
 	}
 
 	void process(const ProcessArgs& args) override {
-		tides::GeneratorMode mode = generator.mode();
+		PROFILE_SCOPE(profiler, 0);
+
+		// Mode and range are shared by all voices
+		tides::GeneratorMode mode = generators[0].mode();
 		if (modeTrigger.process(params[MODE_PARAM].getValue())) {
 			mode = (tides::GeneratorMode)(((int)mode - 1 + 3) % 3);
-			generator.set_mode(mode);
+			setMode(mode);
 		}
-		lights[MODE_GREEN_LIGHT].value = (mode == 2) ? 1.0 : 0.0;
-		lights[MODE_RED_LIGHT].value = (mode == 0) ? 1.0 : 0.0;
 
-		tides::GeneratorRange range = generator.range();
+		tides::GeneratorRange range = generators[0].range();
 		if (rangeTrigger.process(params[RANGE_PARAM].getValue())) {
 			range = (tides::GeneratorRange)(((int)range - 1 + 3) % 3);
-			generator.set_range(range);
+			setRange(range);
+		}
+
+		// Per-sample work is limited to recording gate flags and playing back samples of the current block
+		float unifs[16];
+		for (int c = 0; c < channels; c++) {
+			// Level
+			uint16_t level = clamp((inputs[LEVEL_INPUT].isConnected() ? inputs[LEVEL_INPUT].getPolyVoltage(c) : 8.f) / 8.0f, 0.0f, 1.0f) * 0xffff;
+			if (level < 32)
+				level = 0;
+
+			uint8_t lastGate = lastGates[c];
+			uint8_t gate = 0;
+			if (inputs[FREEZE_INPUT].getPolyVoltage(c) >= 0.7)
+				gate |= tides::CONTROL_FREEZE;
+			if (inputs[TRIG_INPUT].getPolyVoltage(c) >= 0.7)
+				gate |= tides::CONTROL_GATE;
+			if (inputs[CLOCK_INPUT].getPolyVoltage(c) >= 0.7)
+				gate |= tides::CONTROL_CLOCK;
+			if (!(lastGate & tides::CONTROL_CLOCK) && (gate & tides::CONTROL_CLOCK))
+				gate |= tides::CONTROL_GATE_RISING;
+			if (!(lastGate & tides::CONTROL_GATE) && (gate & tides::CONTROL_GATE))
+				gate |= tides::CONTROL_GATE_RISING;
+			if ((lastGate & tides::CONTROL_GATE) && !(gate & tides::CONTROL_GATE))
+				gate |= tides::CONTROL_GATE_FALLING;
+			lastGates[c] = gate;
+			gates[c][frame] = gate;
+
+			const tides::GeneratorSample& sample = samples[c][frame];
+			uint32_t uni = sample.unipolar;
+			int32_t bi = sample.bipolar;
+
+			uni = uni * level >> 16;
+			bi = -bi * level >> 16;
+			float unif = (float) uni / 0xffff;
+			float bif = (float) bi / 0x8000;
+
+			outputs[HIGH_OUTPUT].setVoltage(sample.flags & tides::FLAG_END_OF_ATTACK ? 0.0 : 5.0, c);
+			outputs[LOW_OUTPUT].setVoltage(sample.flags & tides::FLAG_END_OF_RELEASE ? 0.0 : 5.0, c);
+			outputs[UNI_OUTPUT].setVoltage(unif * 8.0, c);
+			outputs[BI_OUTPUT].setVoltage(bif * 5.0, c);
+
+			if (sample.flags & tides::FLAG_END_OF_ATTACK)
+				unif *= -1.0;
+			unifs[c] = unif;
+		}
+		for (int i = 0; i < NUM_OUTPUTS; i++) {
+			outputs[i].setChannels(channels);
 		}
-		lights[RANGE_GREEN_LIGHT].value = (range == 2) ? 1.0 : 0.0;
-		lights[RANGE_RED_LIGHT].value = (range == 0) ? 1.0 : 0.0;
 
 		// Buffer loop
+		// The generator renders 16 samples per call, so all control-rate work for every voice happens here in one pass.
+		// Its ring buffers take one gate flag for each sample read, so each voice also exchanges the whole block's gates and samples with them here.
+		// This delays the outputs by one block compared to exchanging them every sample.
 		if (++frame >= 16) {
 			frame = 0;
 
-			// Pitch
-			float pitch = params[FREQUENCY_PARAM].getValue();
-			pitch += 12.0 * inputs[PITCH_INPUT].getVoltage();
-			pitch += params[FM_PARAM].getValue() * inputs[FM_INPUT].getNormalVoltage(0.1) / 5.0;
-			pitch += 60.0;
+			int newChannels = 1;
+			for (int i = 0; i < NUM_INPUTS; i++) {
+				newChannels = std::max(newChannels, inputs[i].getChannels());
+			}
+			// Channels that were inactive last block recorded no gates and played no samples, so clear what they left from before
+			for (int c = channels; c < newChannels; c++) {
+				std::fill(gates[c], gates[c] + 16, 0);
+				std::fill(samples[c], samples[c] + 16, tides::GeneratorSample());
+				lastGates[c] = 0;
+			}
+			channels = newChannels;
+
 			// Scale to the global sample rate
-			pitch += log2f(48000.0 / args.sampleRate) * 12.0;
-			generator.set_pitch((int) clamp(pitch * 0x80, (float) -0x8000, (float) 0x7fff));
-
-			// Slope, smoothness, pitch
-			int16_t shape = clamp(params[SHAPE_PARAM].getValue() + inputs[SHAPE_INPUT].getVoltage() / 5.0f, -1.0f, 1.0f) * 0x7fff;
-			int16_t slope = clamp(params[SLOPE_PARAM].getValue() + inputs[SLOPE_INPUT].getVoltage() / 5.0f, -1.0f, 1.0f) * 0x7fff;
-			int16_t smoothness = clamp(params[SMOOTHNESS_PARAM].getValue() + inputs[SMOOTHNESS_INPUT].getVoltage() / 5.0f, -1.0f, 1.0f) * 0x7fff;
-			generator.set_shape(shape);
-			generator.set_slope(slope);
-			generator.set_smoothness(smoothness);
-
-			// Sync
+			float pitchOffset = 60.0 + log2f(48000.0 / args.sampleRate) * 12.0;
 			// Slight deviation from spec here.
 			// Instead of toggling sync by holding the range button, just enable it if the clock port is plugged in.
-			generator.set_sync(inputs[CLOCK_INPUT].isConnected() && !sheep);
-
-			// Generator
-			generator.Process(sheep);
+			bool sync = inputs[CLOCK_INPUT].isConnected() && !sheep;
+
+			for (int c = 0; c < channels; c++) {
+				tides::Generator& generator = generators[c];
+				for (int i = 0; i < 16; i++) {
+					samples[c][i] = generator.Process(gates[c][i]);
+				}
+
+				// Pitch
+				float pitch = params[FREQUENCY_PARAM].getValue();
+				pitch += 12.0 * inputs[PITCH_INPUT].getPolyVoltage(c);
+				pitch += params[FM_PARAM].getValue() * (inputs[FM_INPUT].isConnected() ? inputs[FM_INPUT].getPolyVoltage(c) : 0.1f) / 5.0;
+				pitch += pitchOffset;
+				generator.set_pitch((int) clamp(pitch * 0x80, (float) -0x8000, (float) 0x7fff));
+
+				// Slope, smoothness, pitch
+				int16_t shape = clamp(params[SHAPE_PARAM].getValue() + inputs[SHAPE_INPUT].getPolyVoltage(c) / 5.0f, -1.0f, 1.0f) * 0x7fff;
+				int16_t slope = clamp(params[SLOPE_PARAM].getValue() + inputs[SLOPE_INPUT].getPolyVoltage(c) / 5.0f, -1.0f, 1.0f) * 0x7fff;
+				int16_t smoothness = clamp(params[SMOOTHNESS_PARAM].getValue() + inputs[SMOOTHNESS_INPUT].getPolyVoltage(c) / 5.0f, -1.0f, 1.0f) * 0x7fff;
+				generator.set_shape(shape);
+				generator.set_slope(slope);
+				generator.set_smoothness(smoothness);
+
+				// Sync
+				generator.set_sync(sync);
+
+				// Generator
+				PROFILE_SCOPE(profiler, 1);
+				generator.Process(sheep);
+			}
 		}
 
-		// Level
-		uint16_t level = clamp(inputs[LEVEL_INPUT].getNormalVoltage(8.0) / 8.0f, 0.0f, 1.0f) * 0xffff;
-		if (level < 32)
-			level = 0;
-
-		uint8_t gate = 0;
-		if (inputs[FREEZE_INPUT].getVoltage() >= 0.7)
-			gate |= tides::CONTROL_FREEZE;
-		if (inputs[TRIG_INPUT].getVoltage() >= 0.7)
-			gate |= tides::CONTROL_GATE;
-		if (inputs[CLOCK_INPUT].getVoltage() >= 0.7)
-			gate |= tides::CONTROL_CLOCK;
-		if (!(lastGate & tides::CONTROL_CLOCK) && (gate & tides::CONTROL_CLOCK))
-			gate |= tides::CONTROL_GATE_RISING;
-		if (!(lastGate & tides::CONTROL_GATE) && (gate & tides::CONTROL_GATE))
-			gate |= tides::CONTROL_GATE_RISING;
-		if ((lastGate & tides::CONTROL_GATE) && !(gate & tides::CONTROL_GATE))
-			gate |= tides::CONTROL_GATE_FALLING;
-		lastGate = gate;
-
-		const tides::GeneratorSample& sample = generator.Process(gate);
-		uint32_t uni = sample.unipolar;
-		int32_t bi = sample.bipolar;
-
-		uni = uni * level >> 16;
-		bi = -bi * level >> 16;
-		float unif = (float) uni / 0xffff;
-		float bif = (float) bi / 0x8000;
-
-		outputs[HIGH_OUTPUT].setVoltage(sample.flags & tides::FLAG_END_OF_ATTACK ? 0.0 : 5.0);
-		outputs[LOW_OUTPUT].setVoltage(sample.flags & tides::FLAG_END_OF_RELEASE ? 0.0 : 5.0);
-		outputs[UNI_OUTPUT].setVoltage(unif * 8.0);
-		outputs[BI_OUTPUT].setVoltage(bif * 5.0);
-
-		if (sample.flags & tides::FLAG_END_OF_ATTACK)
-			unif *= -1.0;
-		lights[PHASE_GREEN_LIGHT].setSmoothBrightness(fmaxf(0.0, unif), args.sampleTime);
-		lights[PHASE_RED_LIGHT].setSmoothBrightness(fmaxf(0.0, -unif), args.sampleTime);
+		// Lights
+		if (lightDivider.process()) {
+			float lightTime = lightDivider.getSampleTime(args);
+			lights[MODE_GREEN_LIGHT].value = (mode == 2) ? 1.0 : 0.0;
+			lights[MODE_RED_LIGHT].value = (mode == 0) ? 1.0 : 0.0;
+			lights[RANGE_GREEN_LIGHT].value = (range == 2) ? 1.0 : 0.0;
+			lights[RANGE_RED_LIGHT].value = (range == 0) ? 1.0 : 0.0;
+
+			lights[PHASE_GREEN_LIGHT].setSmoothBrightness(fmaxf(0.0, unifs[0]), lightTime);
+			lights[PHASE_RED_LIGHT].setSmoothBrightness(fmaxf(0.0, -unifs[0]), lightTime);
+		}
 	}
 
 	void onReset() override {
-		generator.set_range(tides::GENERATOR_RANGE_MEDIUM);
-		generator.set_mode(tides::GENERATOR_MODE_LOOPING);
+		setRange(tides::GENERATOR_RANGE_MEDIUM);
+		setMode(tides::GENERATOR_MODE_LOOPING);
 		sheep = false;
 	}
 
 	void onRandomize() override {
-		generator.set_range((tides::GeneratorRange)(random::u32() % 3));
-		generator.set_mode((tides::GeneratorMode)(random::u32() % 3));
+		setRange((tides::GeneratorRange)(random::u32() % 3));
+		setMode((tides::GeneratorMode)(random::u32() % 3));
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 
-		json_object_set_new(rootJ, "mode", json_integer((int) generator.mode()));
-		json_object_set_new(rootJ, "range", json_integer((int) generator.range()));
+		json_object_set_new(rootJ, "mode", json_integer((int) generators[0].mode()));
+		json_object_set_new(rootJ, "range", json_integer((int) generators[0].range()));
 		json_object_set_new(rootJ, "sheep", json_boolean(sheep));
 
 		return rootJ;
@@ -192,12 +260,12 @@ struct Tides : Module {
 	void dataFromJson(json_t* rootJ) override {
 		json_t* modeJ = json_object_get(rootJ, "mode");
 		if (modeJ) {
-			generator.set_mode((tides::GeneratorMode) json_integer_value(modeJ));
+			setMode((tides::GeneratorMode) json_integer_value(modeJ));
 		}
 
 		json_t* rangeJ = json_object_get(rootJ, "range");
 		if (rangeJ) {
-			generator.set_range((tides::GeneratorRange) json_integer_value(rangeJ));
+			setRange((tides::GeneratorRange) json_integer_value(rangeJ));
 		}
 
 		json_t* sheepJ = json_object_get(rootJ, "sheep");
@@ -282,6 +350,8 @@ struct TidesWidget : ModuleWidget {
 		menu->addChild(new MenuSeparator);
 
 		menu->addChild(createBoolPtrMenuItem("Wavetable firmware (Sheep)", "", &module->sheep));
+
+		appendProfilerMenu(menu, &module->profiler);
 	}
 };
 
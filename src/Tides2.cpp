@@ -76,9 +76,9 @@ struct Tides2 : Module {
 		NUM_LIGHTS
 	};
 
-	tides2::PolySlopeGenerator poly_slope_generator;
-	tides2::RampExtractor ramp_extractor;
-	stmlib::HysteresisQuantizer ratio_index_quantizer;
+	tides2::PolySlopeGenerator poly_slope_generator[16];
+	tides2::RampExtractor ramp_extractor[16];
+	stmlib::HysteresisQuantizer ratio_index_quantizer[16];
 
 	// State
 	int range;
@@ -89,15 +89,19 @@ struct Tides2 : Module {
 	dsp::BooleanTrigger rampTrigger;
 
 	// Buffers
-	tides2::PolySlopeGenerator::OutputSample out[tides2::kBlockSize] = {};
-	stmlib::GateFlags trig_flags[tides2::kBlockSize] = {};
-	stmlib::GateFlags clock_flags[tides2::kBlockSize] = {};
-	stmlib::GateFlags previous_trig_flag = stmlib::GATE_FLAG_LOW;
-	stmlib::GateFlags previous_clock_flag = stmlib::GATE_FLAG_LOW;
+	tides2::PolySlopeGenerator::OutputSample out[16][tides2::kBlockSize] = {};
+	stmlib::GateFlags trig_flags[16][tides2::kBlockSize] = {};
+	stmlib::GateFlags clock_flags[16][tides2::kBlockSize] = {};
+	stmlib::GateFlags previous_trig_flag[16] = {};
+	stmlib::GateFlags previous_clock_flag[16] = {};
 
 	bool must_reset_ramp_extractor = true;
 	tides2::OutputMode previous_output_mode = tides2::OUTPUT_MODE_GATES;
 	uint8_t frame = 0;
+	int channels = 1;
+	LightDivider lightDivider;
+
+	Profiler profiler{"Tides2", {"Process", "Generator"}};
 
 	Tides2() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -131,10 +135,14 @@ struct Tides2 : Module {
 			configOutput(OUT_OUTPUTS + c, string::f("Channel %d", c + 1));
 		}
 
-		poly_slope_generator.Init();
-		ratio_index_quantizer.Init();
+		for (int c = 0; c < 16; c++) {
+			poly_slope_generator[c].Init();
+			ratio_index_quantizer[c].Init();
+		}
 		onReset();
 		onSampleRateChange();
+		// Stagger block boundaries between instances
+		frame = (int) (nextBlockPhase() * tides2::kBlockSize);
 	}
 
 	void onReset() override {
@@ -150,7 +158,9 @@ struct Tides2 : Module {
 	}
 
 	void onSampleRateChange() override {
-		ramp_extractor.Init(APP->engine->getSampleRate(), 40.f / APP->engine->getSampleRate());
+		for (int c = 0; c < 16; c++) {
+			ramp_extractor[c].Init(APP->engine->getSampleRate(), 40.f / APP->engine->getSampleRate());
+		}
 	}
 
 	json_t* dataToJson() override {
@@ -178,6 +188,8 @@ struct Tides2 : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// Switches
 		if (rangeTrigger.process(params[RANGE_PARAM].getValue() > 0.f)) {
 			range = (range + 1) % 3;
@@ -190,69 +202,102 @@ struct Tides2 : Module {
 		}
 
 		// Input gates
-		trig_flags[frame] = stmlib::ExtractGateFlags(previous_trig_flag, inputs[TRIG_INPUT].getVoltage() >= 1.7f);
-		previous_trig_flag = trig_flags[frame];
-
-		clock_flags[frame] = stmlib::ExtractGateFlags(previous_clock_flag, inputs[CLOCK_INPUT].getVoltage() >= 1.7f);
-		previous_clock_flag = clock_flags[frame];
+		for (int c = 0; c < channels; c++) {
+			trig_flags[c][frame] = stmlib::ExtractGateFlags(previous_trig_flag[c], inputs[TRIG_INPUT].getPolyVoltage(c) >= 1.7f);
+			previous_trig_flag[c] = trig_flags[c][frame];
+			clock_flags[c][frame] = stmlib::ExtractGateFlags(previous_clock_flag[c], inputs[CLOCK_INPUT].getPolyVoltage(c) >= 1.7f);
+			previous_clock_flag[c] = clock_flags[c][frame];
+		}
 
 		// Process block
 		if (++frame >= tides2::kBlockSize) {
 			frame = 0;
 
 			tides2::Range range_mode = (range < 2) ? tides2::RANGE_CONTROL : tides2::RANGE_AUDIO;
-			float note = clamp(params[FREQUENCY_PARAM].getValue() + 12.f * inputs[V_OCT_INPUT].getVoltage(), -96.f, 96.f);
-			float fm = clamp(params[FREQUENCY_CV_PARAM].getValue() * inputs[FREQUENCY_INPUT].getVoltage() * 12.f, -96.f, 96.f);
-			float transposition = note + fm;
-
-			float ramp[tides2::kBlockSize];
-			float frequency;
+			bool clockConnected = inputs[CLOCK_INPUT].isConnected();
+			// A mono clock is shared by all channels, so channels at the same ratio can share a ramp
+			bool sharedClock = (inputs[CLOCK_INPUT].getChannels() <= 1);
 
-			if (inputs[CLOCK_INPUT].isConnected()) {
-				if (must_reset_ramp_extractor) {
-					ramp_extractor.Reset();
+			if (output_mode != previous_output_mode) {
+				for (int c = 0; c < 16; c++) {
+					poly_slope_generator[c].Reset();
 				}
-
-				tides2::Ratio r = ratio_index_quantizer.Lookup(kRatios, 0.5f + transposition * 0.0105f, 20);
-				frequency = ramp_extractor.Process(
-				              range_mode == tides2::RANGE_AUDIO,
-				              range_mode == tides2::RANGE_AUDIO && ramp_mode == tides2::RAMP_MODE_AR,
-				              r,
-				              clock_flags,
-				              ramp,
-				              tides2::kBlockSize);
-				must_reset_ramp_extractor = false;
-			}
-			else {
-				frequency = kRootScaled[range] / args.sampleRate * stmlib::SemitonesToRatio(transposition);
-				must_reset_ramp_extractor = true;
+				previous_output_mode = output_mode;
 			}
 
-			// Get parameters
-			float slope = clamp(params[SLOPE_PARAM].getValue() + dsp::cubic(params[SLOPE_CV_PARAM].getValue()) * inputs[SLOPE_INPUT].getVoltage() / 10.f, 0.f, 1.f);
-			float shape = clamp(params[SHAPE_PARAM].getValue() + dsp::cubic(params[SHAPE_CV_PARAM].getValue()) * inputs[SHAPE_INPUT].getVoltage() / 10.f, 0.f, 1.f);
-			float smoothness = clamp(params[SMOOTHNESS_PARAM].getValue() + dsp::cubic(params[SMOOTHNESS_CV_PARAM].getValue()) * inputs[SMOOTHNESS_INPUT].getVoltage() / 10.f, 0.f, 1.f);
-			float shift = clamp(params[SHIFT_PARAM].getValue() + dsp::cubic(params[SHIFT_CV_PARAM].getValue()) * inputs[SHIFT_INPUT].getVoltage() / 10.f, 0.f, 1.f);
+			float ramp[16][tides2::kBlockSize];
+			tides2::Ratio ratios[16];
+			float frequencies[16];
+
+			for (int c = 0; c < channels; c++) {
+				float note = clamp(params[FREQUENCY_PARAM].getValue() + 12.f * inputs[V_OCT_INPUT].getPolyVoltage(c), -96.f, 96.f);
+				float fm = clamp(params[FREQUENCY_CV_PARAM].getValue() * inputs[FREQUENCY_INPUT].getPolyVoltage(c) * 12.f, -96.f, 96.f);
+				float transposition = note + fm;
+
+				float frequency;
+
+				if (clockConnected) {
+					ratios[c] = ratio_index_quantizer[c].Lookup(kRatios, 0.5f + transposition * 0.0105f, 20);
+
+					// Channels following the same clock at the same ratio reuse the first such channel's ramp.
+					int leader = -1;
+					if (sharedClock) {
+						for (int d = 0; d < c; d++) {
+							if (ratios[d].ratio == ratios[c].ratio && ratios[d].q == ratios[c].q) {
+								leader = d;
+								break;
+							}
+						}
+					}
+
+					if (leader >= 0) {
+						// Copy the extractor state too, so this channel stays locked if its ratio diverges later.
+						ramp_extractor[c] = ramp_extractor[leader];
+						std::copy(ramp[leader], ramp[leader] + tides2::kBlockSize, ramp[c]);
+						frequency = frequencies[leader];
+					}
+					else {
+						if (must_reset_ramp_extractor) {
+							ramp_extractor[c].Reset();
+						}
+						frequency = ramp_extractor[c].Process(
+						              range_mode == tides2::RANGE_AUDIO,
+						              range_mode == tides2::RANGE_AUDIO && ramp_mode == tides2::RAMP_MODE_AR,
+						              ratios[c],
+						              clock_flags[sharedClock ? 0 : c],
+						              ramp[c],
+						              tides2::kBlockSize);
+					}
+				}
+				else {
+					frequency = kRootScaled[range] / args.sampleRate * stmlib::SemitonesToRatio(transposition);
+				}
 
-			if (output_mode != previous_output_mode) {
-				poly_slope_generator.Reset();
-				previous_output_mode = output_mode;
+				frequencies[c] = frequency;
+
+				// Get parameters
+				float slope = clamp(params[SLOPE_PARAM].getValue() + dsp::cubic(params[SLOPE_CV_PARAM].getValue()) * inputs[SLOPE_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+				float shape = clamp(params[SHAPE_PARAM].getValue() + dsp::cubic(params[SHAPE_CV_PARAM].getValue()) * inputs[SHAPE_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+				float smoothness = clamp(params[SMOOTHNESS_PARAM].getValue() + dsp::cubic(params[SMOOTHNESS_CV_PARAM].getValue()) * inputs[SMOOTHNESS_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+				float shift = clamp(params[SHIFT_PARAM].getValue() + dsp::cubic(params[SHIFT_CV_PARAM].getValue()) * inputs[SHIFT_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+
+				// Render generator
+				PROFILE_SCOPE(profiler, 1);
+				poly_slope_generator[c].Render(
+				  ramp_mode,
+				  output_mode,
+				  range_mode,
+				  frequency,
+				  slope,
+				  shape,
+				  smoothness,
+				  shift,
+				  trig_flags[c],
+				  !inputs[TRIG_INPUT].isConnected() && clockConnected ? ramp[c] : NULL,
+				  out[c],
+				  tides2::kBlockSize);
 			}
-
-			// Render generator
-			poly_slope_generator.Render(
-			  ramp_mode,
-			  output_mode,
-			  range_mode,
-			  frequency,
-			  slope,
-			  shape,
-			  smoothness,
-			  shift,
-			  trig_flags,
-			  !inputs[TRIG_INPUT].isConnected() && inputs[CLOCK_INPUT].isConnected() ? ramp : NULL,
-			  out,
-			  tides2::kBlockSize);
+			must_reset_ramp_extractor = !clockConnected;
 
 			// Set lights
 			lights[RANGE_LIGHT + 0].value = (range == 0 || range == 1);
@@ -265,9 +310,34 @@ struct Tides2 : Module {
 
 		// Outputs
 		for (int i = 0; i < 4; i++) {
-			float value = out[frame].channel[i];
-			outputs[OUT_OUTPUTS + i].setVoltage(value);
-			lights[OUTPUT_LIGHTS + i].setSmoothBrightness(value, args.sampleTime);
+			for (int c = 0; c < channels; c++) {
+				outputs[OUT_OUTPUTS + i].setVoltage(out[c][frame].channel[i], c);
+			}
+			outputs[OUT_OUTPUTS + i].setChannels(channels);
+		}
+
+		// The channel count only changes on block boundaries, so every channel renders whole blocks.
+		if (frame == 0) {
+			int newChannels = 1;
+			for (int i = 0; i < NUM_INPUTS; i++) {
+				newChannels = std::max(newChannels, inputs[i].getChannels());
+			}
+			// Silence channels that have not rendered a block yet, and restart their generators and ramp extractors
+			for (int c = channels; c < newChannels; c++) {
+				std::fill(out[c], out[c] + tides2::kBlockSize, tides2::PolySlopeGenerator::OutputSample());
+				poly_slope_generator[c].Reset();
+				ramp_extractor[c].Reset();
+				previous_trig_flag[c] = stmlib::GATE_FLAG_LOW;
+				previous_clock_flag[c] = stmlib::GATE_FLAG_LOW;
+			}
+			channels = newChannels;
+		}
+
+		if (lightDivider.process()) {
+			float lightTime = lightDivider.getSampleTime(args);
+			for (int i = 0; i < 4; i++) {
+				lights[OUTPUT_LIGHTS + i].setSmoothBrightness(out[0][frame].channel[i], lightTime);
+			}
 		}
 	}
 };
@@ -319,6 +389,11 @@ struct Tides2Widget : ModuleWidget {
 		addChild(createLightCentered<MediumLight<GreenLight>>(mm2px(Vec(49.075, 104.749)), module, Tides2::OUTPUT_LIGHTS + 2));
 		addChild(createLightCentered<MediumLight<GreenLight>>(mm2px(Vec(60.525, 104.749)), module, Tides2::OUTPUT_LIGHTS + 3));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Tides2* module = dynamic_cast<Tides2*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
@@ -39,6 +39,10 @@ struct Veils : Module {
 		NUM_LIGHTS
 	};
 
+	LightDivider lightDivider;
+
+	Profiler profiler{"Veils", {"Process"}};
+
 	Veils() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		for (int c = 0; c < 4; c++) {
@@ -51,23 +55,53 @@ struct Veils : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
-		float out = 0.0;
+		PROFILE_SCOPE(profiler, 0);
+
+		simd::float_4 out[4] = {};
+		// Number of channels summed into `out` by the rows above
+		int carried = 1;
+		bool updateLights = lightDivider.process();
+		float lightTime = lightDivider.getSampleTime(args);
 
 		for (int i = 0; i < 4; i++) {
-			float in = inputs[IN1_INPUT + i].getVoltage() * params[GAIN1_PARAM + i].getValue();
-			if (inputs[CV1_INPUT + i].isConnected()) {
-				float linear = fmaxf(inputs[CV1_INPUT + i].getVoltage() / 5.0, 0.0);
-				linear = clamp(linear, 0.0f, 2.0f);
-				const float base = 200.0;
-				float exponential = rescale(powf(base, linear / 2.0f), 1.0f, base, 0.0f, 10.0f);
-				in *= crossfade(exponential, linear, params[RESPONSE1_PARAM + i].getValue());
+			float gain = params[GAIN1_PARAM + i].getValue();
+			float response = params[RESPONSE1_PARAM + i].getValue();
+			bool cvConnected = inputs[CV1_INPUT + i].isConnected();
+			int channels = std::max(carried, inputs[IN1_INPUT + i].getChannels());
+			channels = std::max(channels, inputs[CV1_INPUT + i].getChannels());
+			// A mono sum carried from the rows above applies to every channel of a wider row
+			if (carried == 1) {
+				simd::float_4 mono = out[0][0];
+				for (int c = 0; c < channels; c += 4) {
+					out[c / 4] = mono;
+				}
+			}
+
+			for (int c = 0; c < channels; c += 4) {
+				simd::float_4 in = inputs[IN1_INPUT + i].getPolyVoltageSimd<simd::float_4>(c) * gain;
+				if (cvConnected) {
+					simd::float_4 linear = inputs[CV1_INPUT + i].getPolyVoltageSimd<simd::float_4>(c) / 5.f;
+					linear = simd::clamp(linear, 0.f, 2.f);
+					simd::float_4 exponential = expResponse(linear / 2.f) * 10.f;
+					in *= exponential + (linear - exponential) * response;
+				}
+				out[c / 4] += in;
+			}
+
+			if (updateLights) {
+				lights[OUT1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, out[0][0] / 5.0), lightTime);
+				lights[OUT1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -out[0][0] / 5.0), lightTime);
 			}
-			out += in;
-			lights[OUT1_POS_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, out / 5.0), args.sampleTime);
-			lights[OUT1_NEG_LIGHT + 2 * i].setSmoothBrightness(fmaxf(0.0, -out / 5.0), args.sampleTime);
 			if (outputs[OUT1_OUTPUT + i].isConnected()) {
-				outputs[OUT1_OUTPUT + i].setVoltage(out);
-				out = 0.0;
+				outputs[OUT1_OUTPUT + i].setChannels(channels);
+				for (int c = 0; c < channels; c += 4) {
+					outputs[OUT1_OUTPUT + i].setVoltageSimd(out[c / 4], c);
+					out[c / 4] = 0.f;
+				}
+				carried = 1;
+			}
+			else {
+				carried = channels;
 			}
 		}
 	}
@@ -114,6 +148,11 @@ struct VeilsWidget : ModuleWidget {
 		addChild(createLight<MediumLight<GreenRedLight>>(Vec(152, 245), module, Veils::OUT3_POS_LIGHT));
 		addChild(createLight<MediumLight<GreenRedLight>>(Vec(152, 324), module, Veils::OUT4_POS_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Veils* module = dynamic_cast<Veils*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
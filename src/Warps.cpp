@@ -32,11 +32,22 @@ struct Warps : Module {
 	};
 
 
-	int frame = 0;
-	warps::Modulator modulator;
-	warps::ShortFrame inputFrames[60] = {};
-	warps::ShortFrame outputFrames[60] = {};
+	// The firmware's filter bank and oscillators are tuned for the hardware's 96 kHz, so the modulators run at that rate.
+	static const int SAMPLE_RATE = 96000;
+	// The filter bank decimates by up to 3 and 4, so blocks must be a multiple of 12 samples.
+	static const int BLOCK_SIZE = 12;
+
+	int channels = 1;
+	int carrierShape = 0;
+	warps::Modulator modulators[16];
+	dsp::SampleRateConverter<16 * 2> inputSrc;
+	dsp::SampleRateConverter<16 * 2> outputSrc;
+	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> inputBuffer;
+	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
 	dsp::SchmittTrigger stateTrigger;
+	LightDivider lightDivider;
+
+	Profiler profiler{"Warps", {"Process", "Input SRC", "Modulator", "Output SRC"}};
 
 	Warps() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -58,76 +69,141 @@ struct Warps : Module {
 
 		configBypass(MODULATOR_INPUT, MODULATOR_OUTPUT);
 
-		memset(&modulator, 0, sizeof(modulator));
-		modulator.Init(96000.0f);
+		for (int c = 0; c < 16; c++) {
+			memset(&modulators[c], 0, sizeof(modulators[c]));
+			modulators[c].Init(SAMPLE_RATE);
+		}
+		staggerBlocks(outputBuffer, BLOCK_SIZE * APP->engine->getSampleRate() / SAMPLE_RATE);
 	}
 
 	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+
 		// State trigger
-		warps::Parameters* p = modulator.mutable_parameters();
 		if (stateTrigger.process(params[STATE_PARAM].getValue())) {
-			p->carrier_shape = (p->carrier_shape + 1) % 4;
+			carrierShape = (carrierShape + 1) % 4;
+		}
+		if (lightDivider.process()) {
+			lights[CARRIER_GREEN_LIGHT].value = (carrierShape == 1 || carrierShape == 2) ? 1.0 : 0.0;
+			lights[CARRIER_RED_LIGHT].value = (carrierShape == 2 || carrierShape == 3) ? 1.0 : 0.0;
 		}
-		lights[CARRIER_GREEN_LIGHT].value = (p->carrier_shape == 1 || p->carrier_shape == 2) ? 1.0 : 0.0;
-		lights[CARRIER_RED_LIGHT].value = (p->carrier_shape == 2 || p->carrier_shape == 3) ? 1.0 : 0.0;
 
-		// Buffer loop
-		if (++frame >= 60) {
-			frame = 0;
+		// Get input
+		if (!inputBuffer.full()) {
+			dsp::Frame<16 * 2> inputFrame = {};
+			for (int c = 0; c < channels; c++) {
+				inputFrame.samples[c * 2 + 0] = inputs[CARRIER_INPUT].getPolyVoltage(c) / 16.f;
+				inputFrame.samples[c * 2 + 1] = inputs[MODULATOR_INPUT].getPolyVoltage(c) / 16.f;
+			}
+			inputBuffer.push(inputFrame);
+		}
 
-			p->channel_drive[0] = clamp(params[LEVEL1_PARAM].getValue() + inputs[LEVEL1_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-			p->channel_drive[1] = clamp(params[LEVEL2_PARAM].getValue() + inputs[LEVEL2_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-			p->modulation_algorithm = clamp(params[ALGORITHM_PARAM].getValue() / 8.0f + inputs[ALGORITHM_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
+		// Render frames
+		if (outputBuffer.empty()) {
+			// Voices added here start from silence, since the input buffer holds no samples for them yet.
+			int newChannels = 1;
+			for (int i = 0; i < NUM_INPUTS; i++) {
+				newChannels = std::max(newChannels, inputs[i].getChannels());
+			}
 
+			// Convert input buffer
+			dsp::Frame<16 * 2> inputFrames[BLOCK_SIZE] = {};
 			{
-				// TODO
-				// Use the correct light color
-				NVGcolor algorithmColor = nvgHSL(p->modulation_algorithm, 1.0, 0.5);
-				lights[ALGORITHM_LIGHT + 0].setBrightness(algorithmColor.r);
-				lights[ALGORITHM_LIGHT + 1].setBrightness(algorithmColor.g);
-				lights[ALGORITHM_LIGHT + 2].setBrightness(algorithmColor.b);
+				PROFILE_SCOPE(profiler, 1);
+				inputSrc.setRates(args.sampleRate, SAMPLE_RATE);
+				inputSrc.setChannels(channels * 2);
+				int inLen = inputBuffer.size();
+				int outLen = BLOCK_SIZE;
+				inputSrc.process(inputBuffer.startData(), &inLen, inputFrames, &outLen);
+				inputBuffer.startIncr(inLen);
+			}
+			channels = newChannels;
+
+			dsp::Frame<16 * 2> outputFrames[BLOCK_SIZE];
+			for (int c = 0; c < channels; c++) {
+				warps::Parameters* p = modulators[c].mutable_parameters();
+				p->carrier_shape = carrierShape;
+				p->channel_drive[0] = clamp(params[LEVEL1_PARAM].getValue() + inputs[LEVEL1_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+				p->channel_drive[1] = clamp(params[LEVEL2_PARAM].getValue() + inputs[LEVEL2_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+				p->modulation_algorithm = clamp(params[ALGORITHM_PARAM].getValue() / 8.0f + inputs[ALGORITHM_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+
+				if (c == 0) {
+					// TODO
+					// Use the correct light color
+					NVGcolor algorithmColor = nvgHSL(p->modulation_algorithm, 1.0, 0.5);
+					lights[ALGORITHM_LIGHT + 0].setBrightness(algorithmColor.r);
+					lights[ALGORITHM_LIGHT + 1].setBrightness(algorithmColor.g);
+					lights[ALGORITHM_LIGHT + 2].setBrightness(algorithmColor.b);
+				}
+
+				p->modulation_parameter = clamp(params[TIMBRE_PARAM].getValue() + inputs[TIMBRE_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+
+				p->frequency_shift_pot = params[ALGORITHM_PARAM].getValue() / 8.0;
+				p->frequency_shift_cv = clamp(inputs[ALGORITHM_INPUT].getPolyVoltage(c) / 5.0f, -1.0f, 1.0f);
+				p->phase_shift = p->modulation_algorithm;
+				p->note = 60.0 * params[LEVEL1_PARAM].getValue() + 12.0 * (inputs[LEVEL1_INPUT].isConnected() ? inputs[LEVEL1_INPUT].getPolyVoltage(c) : 2.f) + 12.0;
+
+				// warps::Modulator::Process() only takes 16-bit frames, which it converts to float internally.
+				// So the signal is float everywhere but at this call, and rounded rather than truncated to keep the quantization error unbiased.
+				warps::ShortFrame input[BLOCK_SIZE];
+				warps::ShortFrame output[BLOCK_SIZE];
+				for (int i = 0; i < BLOCK_SIZE; i++) {
+					input[i].l = std::round(clamp(inputFrames[i].samples[c * 2 + 0] * 32768.f, -32768.f, 32767.f));
+					input[i].r = std::round(clamp(inputFrames[i].samples[c * 2 + 1] * 32768.f, -32768.f, 32767.f));
+				}
+				{
+					PROFILE_SCOPE(profiler, 2);
+					modulators[c].Process(input, output, BLOCK_SIZE);
+				}
+				for (int i = 0; i < BLOCK_SIZE; i++) {
+					outputFrames[i].samples[c * 2 + 0] = output[i].l / 32768.f;
+					outputFrames[i].samples[c * 2 + 1] = output[i].r / 32768.f;
+				}
 			}
 
-			p->modulation_parameter = clamp(params[TIMBRE_PARAM].getValue() + inputs[TIMBRE_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-
-			p->frequency_shift_pot = params[ALGORITHM_PARAM].getValue() / 8.0;
-			p->frequency_shift_cv = clamp(inputs[ALGORITHM_INPUT].getVoltage() / 5.0f, -1.0f, 1.0f);
-			p->phase_shift = p->modulation_algorithm;
-			p->note = 60.0 * params[LEVEL1_PARAM].getValue() + 12.0 * inputs[LEVEL1_INPUT].getNormalVoltage(2.0) + 12.0;
-			p->note += log2f(96000.0f * args.sampleTime) * 12.0f;
-
-			modulator.Process(inputFrames, outputFrames, 60);
+			// Convert output buffer
+			{
+				PROFILE_SCOPE(profiler, 3);
+				outputSrc.setRates(SAMPLE_RATE, args.sampleRate);
+				outputSrc.setChannels(channels * 2);
+				int inLen = BLOCK_SIZE;
+				int outLen = outputBuffer.capacity();
+				outputSrc.process(outputFrames, &inLen, outputBuffer.endData(), &outLen);
+				outputBuffer.endIncr(outLen);
+			}
 		}
 
-		inputFrames[frame].l = clamp((int)(inputs[CARRIER_INPUT].getVoltage() / 16.0 * 0x8000), -0x8000, 0x7fff);
-		inputFrames[frame].r = clamp((int)(inputs[MODULATOR_INPUT].getVoltage() / 16.0 * 0x8000), -0x8000, 0x7fff);
-		outputs[MODULATOR_OUTPUT].setVoltage((float)outputFrames[frame].l / 0x8000 * 5.0);
-		outputs[AUX_OUTPUT].setVoltage((float)outputFrames[frame].r / 0x8000 * 5.0);
+		// Set output
+		if (!outputBuffer.empty()) {
+			dsp::Frame<16 * 2> outputFrame = outputBuffer.shift();
+			for (int c = 0; c < channels; c++) {
+				outputs[MODULATOR_OUTPUT].setVoltage(outputFrame.samples[c * 2 + 0] * 5.f, c);
+				outputs[AUX_OUTPUT].setVoltage(outputFrame.samples[c * 2 + 1] * 5.f, c);
+			}
+		}
+		outputs[MODULATOR_OUTPUT].setChannels(channels);
+		outputs[AUX_OUTPUT].setChannels(channels);
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
-		warps::Parameters* p = modulator.mutable_parameters();
-		json_object_set_new(rootJ, "shape", json_integer(p->carrier_shape));
+		json_object_set_new(rootJ, "shape", json_integer(carrierShape));
 		return rootJ;
 	}
 
 	void dataFromJson(json_t* rootJ) override {
 		json_t* shapeJ = json_object_get(rootJ, "shape");
-		warps::Parameters* p = modulator.mutable_parameters();
 		if (shapeJ) {
-			p->carrier_shape = json_integer_value(shapeJ);
+			carrierShape = json_integer_value(shapeJ);
 		}
 	}
 
 	void onReset() override {
-		warps::Parameters* p = modulator.mutable_parameters();
-		p->carrier_shape = 0;
+		carrierShape = 0;
 	}
 
 	void onRandomize() override {
-		warps::Parameters* p = modulator.mutable_parameters();
-		p->carrier_shape = random::u32() % 4;
+		carrierShape = random::u32() % 4;
 	}
 };
 
@@ -161,6 +237,11 @@ struct WarpsWidget : ModuleWidget {
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(21, 167), module, Warps::CARRIER_GREEN_LIGHT));
 		addChild(createLightCentered<Rogan6PSLight<RedGreenBlueLight>>(Vec(73.556641, 96.560532), module, Warps::ALGORITHM_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Warps* module = dynamic_cast<Warps*>(this->module);
+		appendProfilerMenu(menu, &module->profiler);
+	}
 };
 
 
@@ -1,8 +1,163 @@
 #include "plugin.hpp"
+#include <thread>
+#if defined ARCH_LIN || defined ARCH_MAC
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
 
 
 Plugin* pluginInstance;
 
+
+float nextBlockPhase() {
+	static std::atomic<uint32_t> counter{0};
+	// Multiplying by 2^32 / golden ratio wraps around to the fractional part of the sequence
+	uint32_t phase = counter++ * 2654435769u;
+	return (phase >> 8) / 16777216.f;
+}
+
+
+Arena::Arena(size_t capacity, bool fileBacked) : capacity(capacity) {
+#if defined ARCH_LIN || defined ARCH_MAC
+	if (fileBacked) {
+		std::string path = system::join(system::getTempDirectory(), "AudibleInstruments-arena-XXXXXX");
+		int fd = mkstemp(&path[0]);
+		if (fd >= 0) {
+			// The mapping keeps the file alive, and the OS deletes it once unmapped, even after a crash
+			unlink(path.c_str());
+			if (ftruncate(fd, capacity) == 0) {
+				int flags = MAP_SHARED;
+#if defined MAP_POPULATE
+				// Fault the pages in now, on the thread building the arena, rather than when the engine thread first writes them
+				flags |= MAP_POPULATE;
+#endif
+				void* ptr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, flags, fd, 0);
+				if (ptr != MAP_FAILED) {
+					data = (uint8_t*) ptr;
+					mapped = true;
+#if !defined MAP_POPULATE
+					madvise(data, capacity, MADV_WILLNEED);
+#endif
+				}
+			}
+			close(fd);
+		}
+		if (mapped)
+			return;
+		WARN("Could not map arena to a temporary file, allocating it in memory");
+	}
+#endif
+
+	const size_t hugePageSize = 2 << 20;
+	size_t alignment = ALIGNMENT;
+	size_t size = capacity;
+	if (capacity >= hugePageSize) {
+		alignment = hugePageSize;
+		size = (capacity + hugePageSize - 1) / hugePageSize * hugePageSize;
+	}
+
+#if defined ARCH_WIN
+	data = (uint8_t*) _aligned_malloc(size, alignment);
+#else
+	void* ptr = NULL;
+	if (posix_memalign(&ptr, alignment, size) == 0)
+		data = (uint8_t*) ptr;
+#endif
+	if (!data)
+		throw std::bad_alloc();
+
+#if defined ARCH_LIN && defined MADV_HUGEPAGE
+	// Advise before allocate() first touches the pages
+	if (alignment == hugePageSize)
+		madvise(data, size, MADV_HUGEPAGE);
+#endif
+}
+
+
+Arena::~Arena() {
+#if defined ARCH_LIN || defined ARCH_MAC
+	if (mapped) {
+		munmap(data, capacity);
+		return;
+	}
+#endif
+#if defined ARCH_WIN
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+
+static std::atomic<int> backgroundInitCount{0};
+
+void BackgroundInit::start(std::function<void()> init) {
+	backgroundInitCount++;
+	future = std::async(std::launch::async, [this, init]() {
+		init();
+		ready.store(true, std::memory_order_release);
+		backgroundInitCount--;
+	});
+}
+
+
+void waitForBackgroundInits() {
+	while (backgroundInitCount > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+
+static std::atomic<int> cpuGovernorLevel{0};
+
+void stepCpuGovernor() {
+	static double lastTime = 0.0;
+	static double overloadTime = 0.0;
+	static double headroomTime = 0.0;
+
+	// Several widgets may call this every frame, so only update at a fixed interval
+	double time = system::getTime();
+	double deltaTime = time - lastTime;
+	if (deltaTime < 0.1)
+		return;
+	lastTime = time;
+	// Ignore the gap since the last call if no governed widget was visible for a while
+	deltaTime = std::min(deltaTime, 1.0);
+
+	// Fraction of the block duration spent processing
+	double load = APP->engine->getMeterMax();
+	if (load > 0.9) {
+		overloadTime += deltaTime;
+		headroomTime = 0.0;
+	}
+	else if (load < 0.6) {
+		headroomTime += deltaTime;
+		overloadTime = 0.0;
+	}
+	else {
+		overloadTime = 0.0;
+		headroomTime = 0.0;
+	}
+
+	// Step down quickly and back up slowly
+	int level = cpuGovernorLevel;
+	if (overloadTime >= 0.3 && level < CPU_GOVERNOR_MAX_LEVEL) {
+		level++;
+		overloadTime = 0.0;
+	}
+	else if (headroomTime >= 5.0 && level > 0) {
+		level--;
+		headroomTime = 0.0;
+	}
+	cpuGovernorLevel = level;
+}
+
+
+int getCpuGovernorLevel() {
+	return cpuGovernorLevel.load(std::memory_order_relaxed);
+}
+
+
 void init(rack::Plugin* p) {
 	pluginInstance = p;
 
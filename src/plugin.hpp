@@ -1,4 +1,9 @@
 #include <rack.hpp>
+#include <future>
+#include "profiler.hpp"
+#if defined __x86_64__ || defined __i386__
+	#include <xmmintrin.h>
+#endif
 
 
 using namespace rack;
@@ -36,3 +41,239 @@ struct Rogan6PSLight : Base {
 		this->borderColor = nvgRGBA(0, 0, 0, 0);
 	}
 };
+
+
+/** Exponential response of the SSM2164 VCAs in Veils and Frames.
+Maps `x` in [0, 1] to (200^x - 1) / 199, so the curve starts at 0 and ends at 1.
+Uses dsp::exp2_taylor5() instead of powf() so it also vectorizes with `T = simd::float_4`.
+*/
+template <typename T>
+T expResponse(T x) {
+	const float base = 200.f;
+	// log2(base)
+	const float log2Base = 7.643856f;
+	return (dsp::exp2_taylor5(x * log2Base) - 1.f) * (1.f / (base - 1.f));
+}
+
+
+/** Decimates light updates to a control rate.
+Call process() every sample and only write lights when it returns true.
+Pass getSampleTime() to setSmoothBrightness() so the smoothing time constant matches per-sample updates.
+*/
+struct LightDivider {
+	dsp::ClockDivider divider;
+
+	LightDivider(uint32_t division = 32) {
+		divider.setDivision(division);
+	}
+
+	void setDivision(uint32_t division) {
+		divider.setDivision(division);
+	}
+
+	bool process() {
+		return divider.process();
+	}
+
+	/** Returns the time between light updates. */
+	float getSampleTime(const Module::ProcessArgs& args) {
+		return args.sampleTime * divider.getDivision();
+	}
+};
+
+
+/** Passes settings from the UI thread to the engine thread without locks.
+The UI thread edits ui() and calls publish().
+The engine thread calls fetch() at block boundaries and reads engine(), which never changes in the middle of a block.
+Triple-buffered, so neither thread waits and a half-written value is never seen.
+*/
+template <typename T>
+struct SettingsBuffer {
+	T buffers[3] = {};
+	int uiIndex = 0;
+	int engineIndex = 1;
+	/** Index of the spare buffer, plus NEW_FLAG if it holds settings not yet fetched */
+	std::atomic<int> spareIndex{2};
+	static const int NEW_FLAG = 4;
+
+	/** Settings as last edited on the UI thread */
+	T& ui() {
+		return buffers[uiIndex];
+	}
+
+	void publish() {
+		const T settings = buffers[uiIndex];
+		uiIndex = spareIndex.exchange(uiIndex | NEW_FLAG) & ~NEW_FLAG;
+		buffers[uiIndex] = settings;
+	}
+
+	/** Returns true if newer settings were published since the last fetch. */
+	bool fetch() {
+		if (!(spareIndex.load() & NEW_FLAG))
+			return false;
+		engineIndex = spareIndex.exchange(engineIndex) & ~NEW_FLAG;
+		return true;
+	}
+
+	/** Settings as last fetched on the engine thread */
+	const T& engine() const {
+		return buffers[engineIndex];
+	}
+};
+
+
+/** Flushes denormals to zero within a scope.
+Decaying feedback paths otherwise produce denormals, which are many times slower to compute on most CPUs.
+Rack sets this mode on its engine threads already, so the guard only writes the control register when a host hasn't, and restores it afterward.
+*/
+struct DenormalGuard {
+#if defined __x86_64__ || defined __i386__
+	// Flush-to-zero and denormals-are-zero bits of MXCSR
+	static const unsigned int FLAGS = 0x8040;
+	unsigned int csr;
+
+	DenormalGuard() {
+		csr = _mm_getcsr();
+		if ((csr & FLAGS) != FLAGS)
+			_mm_setcsr(csr | FLAGS);
+	}
+
+	~DenormalGuard() {
+		if ((csr & FLAGS) != FLAGS)
+			_mm_setcsr(csr);
+	}
+#elif defined __aarch64__
+	// Flush-to-zero bit of FPCR, which also treats denormal inputs as zero
+	static const uint64_t FLAGS = 1 << 24;
+	uint64_t fpcr;
+
+	DenormalGuard() {
+		__asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+		if (!(fpcr & FLAGS))
+			__asm__ volatile("msr fpcr, %0" : : "r"(fpcr | FLAGS));
+	}
+
+	~DenormalGuard() {
+		if (!(fpcr & FLAGS))
+			__asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+	}
+#endif
+};
+
+
+/** One zeroed allocation that a module carves all of its DSP state out of.
+Objects are laid out in allocation order, so allocate the state touched every block first and large, sparsely touched buffers after it.
+Destructors of created objects are never called. The eurorack classes own no resources, so they don't need them.
+Arenas of 2 MiB or more are aligned to 2 MiB and advised to be backed by huge pages on Linux.
+Memory is zeroed when it is handed out rather than up front, so the cost lands on whichever thread builds the state.
+A file-backed arena maps an unlinked temporary file instead, so the OS can page its cold parts out to disk.
+The mapping is shared, so the OS also writes dirty pages back to the file, and pages touched again after being evicted fault in from disk.
+Its pages are faulted in when it is mapped, so only pages evicted later stall.
+Either can stall the thread writing to the arena, so only use it where the user accepts the risk of dropouts.
+*/
+struct Arena {
+	/** Cache line size, which also covers SIMD alignment */
+	static const size_t ALIGNMENT = 64;
+
+	uint8_t* data = NULL;
+	size_t capacity = 0;
+	size_t used = 0;
+	/** Whether `data` is a mapped file, whose fresh pages are already zero */
+	bool mapped = false;
+
+	explicit Arena(size_t capacity, bool fileBacked = false);
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	/** Returns zeroed memory aligned to at least ALIGNMENT. */
+	void* allocate(size_t size, size_t alignment = ALIGNMENT) {
+		alignment = std::max(alignment, ALIGNMENT);
+		size_t offset = (used + alignment - 1) & ~(alignment - 1);
+		assert(offset + size <= capacity);
+		used = offset + size;
+		if (!mapped)
+			std::memset(data + offset, 0, size);
+		return data + offset;
+	}
+
+	/** Default-constructs `count` objects in zeroed memory. */
+	template <typename T>
+	T* create(size_t count = 1) {
+		T* objects = (T*) allocate(sizeof(T) * count, alignof(T));
+		for (size_t i = 0; i < count; i++) {
+			new (&objects[i]) T;
+		}
+		return objects;
+	}
+
+	/** Returns the capacity taken by create<T>(count), for sizing an arena up front. */
+	template <typename T>
+	static constexpr size_t sizeOf(size_t count = 1) {
+		return (sizeof(T) * count + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+};
+
+
+/** Runs the heavy part of a module's construction on a worker thread, so opening a patch with many large modules doesn't stall.
+process() must return early until isReady(), and nothing else may touch the state being built before then.
+Declare it after the members it initializes, so that its destructor waits for the worker before they are destroyed.
+*/
+struct BackgroundInit {
+	std::future<void> future;
+	std::atomic<bool> ready{false};
+
+	void start(std::function<void()> init);
+
+	bool isReady() {
+		return ready.load(std::memory_order_acquire);
+	}
+
+	void wait() {
+		if (future.valid())
+			future.wait();
+	}
+
+	~BackgroundInit() {
+		wait();
+	}
+};
+
+/** Blocks until every started BackgroundInit has finished, e.g. before rendering a patch offline. */
+void waitForBackgroundInits();
+
+
+/** Returns a different phase in [0, 1) on each call.
+Successive phases follow the golden ratio sequence, so any number of instances spreads out evenly.
+*/
+float nextBlockPhase();
+
+
+/** Delays the first block of a module that renders whenever its output buffer runs dry, by queueing a random fraction of a block of silence.
+`blockFrames` is the number of engine frames one block produces.
+Block boundaries of different instances then fall on different engine frames, so their rendering cost doesn't pile up on the same frame.
+*/
+template <typename TFrame, size_t S>
+void staggerBlocks(dsp::DoubleRingBuffer<TFrame, S>& outputBuffer, float blockFrames) {
+	int len = std::min((int) (nextBlockPhase() * blockFrames), (int) outputBuffer.capacity());
+	std::memset(outputBuffer.endData(), 0, len * sizeof(TFrame));
+	outputBuffer.endIncr(len);
+}
+
+
+/** Plugin-wide CPU governor.
+Watches the engine's CPU meter and raises a quality reduction level from 0 to CPU_GOVERNOR_MAX_LEVEL when blocks approach their time budget.
+The level drops again only after a sustained period of headroom, so quality doesn't oscillate.
+Instances opt in individually and pick cheaper settings while the level is raised, without changing their saved settings.
+*/
+static const int CPU_GOVERNOR_MAX_LEVEL = 2;
+/** Updates the level. Call from the UI thread, e.g. from ModuleWidget::step() of opted-in instances. */
+void stepCpuGovernor();
+/** Safe to call from any thread. */
+int getCpuGovernorLevel();
+
+
+/** Adds the per-instance CPU governor opt-in to a context menu. */
+inline void appendCpuGovernorMenu(Menu* menu, bool* governed) {
+	menu->addChild(createBoolPtrMenuItem("Reduce quality under CPU load", getCpuGovernorLevel() > 0 ? "Active" : "", governed));
+}
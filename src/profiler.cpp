@@ -0,0 +1,180 @@
+#include "plugin.hpp"
+
+#ifdef PROFILE
+
+#include <thread>
+
+
+struct TraceEvent {
+	const char* moduleName;
+	const char* stageName;
+	const void* instance;
+	uint32_t threadId;
+	uint64_t startTime;
+	uint64_t endTime;
+};
+
+
+/** Bounded multi-producer, single-consumer queue.
+Each slot carries a sequence number, so producers claim slots with one compare-exchange and never wait on the consumer.
+When the queue is full, events are dropped and counted.
+*/
+struct TraceQueue {
+	static const size_t SIZE = 1 << 16;
+
+	struct Slot {
+		std::atomic<size_t> sequence;
+		TraceEvent event;
+	};
+
+	Slot slots[SIZE];
+	std::atomic<size_t> head{0};
+	/** Only touched by the consumer */
+	size_t tail = 0;
+	std::atomic<uint32_t> dropped{0};
+
+	TraceQueue() {
+		for (size_t i = 0; i < SIZE; i++) {
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	void push(const TraceEvent& event) {
+		size_t pos = head.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = slots[pos % SIZE];
+			size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+			if (diff == 0) {
+				if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					slot.event = event;
+					slot.sequence.store(pos + 1, std::memory_order_release);
+					return;
+				}
+			}
+			else if (diff < 0) {
+				// The consumer hasn't freed this slot yet
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else {
+				pos = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(TraceEvent* event) {
+		Slot& slot = slots[tail % SIZE];
+		size_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if ((intptr_t) sequence - (intptr_t) (tail + 1) < 0)
+			return false;
+		*event = slot.event;
+		slot.sequence.store(tail + SIZE, std::memory_order_release);
+		tail++;
+		return true;
+	}
+};
+
+
+// Producers may still be pushing just after a trace stops, so the queue is never freed.
+static TraceQueue traceQueue;
+static std::atomic<bool> tracing{false};
+static std::atomic<uint32_t> nextThreadId{0};
+
+
+/** Finishes a trace still running when the plugin is unloaded or Rack quits, since destroying a joinable std::thread terminates the process */
+struct TraceThread {
+	std::thread thread;
+
+	~TraceThread() {
+		stopTrace();
+	}
+};
+
+// Defined after the queue, so it is destroyed first
+static TraceThread traceThread;
+
+
+static void writeTrace(std::string path) {
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file) {
+		WARN("Could not write trace to %s", path.c_str());
+		return;
+	}
+
+	uint64_t origin = getTraceTime();
+	bool first = true;
+	std::fprintf(file, "[\n");
+
+	auto drain = [&]() {
+		TraceEvent event;
+		while (traceQueue.pop(&event)) {
+			// Events queued before this trace started
+			if (event.startTime < origin)
+				continue;
+			std::fprintf(file, "%s{\"name\": \"%s %s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %u, \"args\": {\"instance\": \"%p\"}}",
+				first ? "" : ",\n",
+				event.moduleName, event.stageName, event.moduleName,
+				(event.startTime - origin) / 1000.0, (event.endTime - event.startTime) / 1000.0,
+				event.threadId, event.instance);
+			first = false;
+		}
+	};
+
+	while (tracing) {
+		drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	drain();
+
+	std::fprintf(file, "\n]\n");
+	std::fclose(file);
+
+	uint32_t dropped = traceQueue.dropped.exchange(0);
+	INFO("Wrote trace to %s (%u events dropped)", path.c_str(), dropped);
+}
+
+
+void startTrace() {
+	if (tracing)
+		return;
+	std::string path = asset::user(string::f("AudibleInstruments-trace-%lld.json", (long long) system::getUnixTime()));
+	tracing = true;
+	traceThread.thread = std::thread(writeTrace, path);
+}
+
+
+void stopTrace() {
+	if (!tracing)
+		return;
+	tracing = false;
+	if (traceThread.thread.joinable())
+		traceThread.thread.join();
+}
+
+
+bool isTracing() {
+	return tracing.load(std::memory_order_relaxed);
+}
+
+
+uint64_t getTraceTime() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void traceEvent(const char* moduleName, const char* stageName, const void* instance, uint64_t startTime, uint64_t endTime) {
+	// Chrome traces group events by thread, and Rack runs modules on several engine threads
+	static thread_local uint32_t threadId = nextThreadId++;
+
+	TraceEvent event;
+	event.moduleName = moduleName;
+	event.stageName = stageName;
+	event.instance = instance;
+	event.threadId = threadId;
+	event.startTime = startTime;
+	event.endTime = endTime;
+	traceQueue.push(event);
+}
+
+#endif
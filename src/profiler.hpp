@@ -0,0 +1,184 @@
+#pragma once
+#include <rack.hpp>
+#if defined PROFILE && (defined __x86_64__ || defined __i386__)
+	#include <x86intrin.h>
+#endif
+
+
+/** Per-instance timers for the stages of a module's process().
+Only compiled in with `make PROFILE=1`. Otherwise Profiler is empty and PROFILE_SCOPE() expands to nothing.
+
+Usage:
+
+	Profiler profiler{"Plaits", {"Process", "Render"}};
+
+	void process(const ProcessArgs& args) override {
+		PROFILE_SCOPE(profiler, 0);
+		...
+		{
+			PROFILE_SCOPE(profiler, 1);
+			voice.Render(...);
+		}
+	}
+*/
+#ifdef PROFILE
+
+/** Chrome trace recording, shared by all instances and implemented in profiler.cpp.
+While recording, block stages (every stage except 0, which runs every sample) are queued as trace events.
+A background thread writes them to a trace event JSON file in the user folder, which can be opened in chrome://tracing or Perfetto.
+*/
+void startTrace();
+void stopTrace();
+bool isTracing();
+/** Returns a monotonic timestamp in nanoseconds. */
+uint64_t getTraceTime();
+/** Queues an event without blocking. Safe to call from any engine thread. */
+void traceEvent(const char* moduleName, const char* stageName, const void* instance, uint64_t startTime, uint64_t endTime);
+
+
+struct Profiler {
+	static const int MAX_STAGES = 8;
+	static const int HISTORY_SIZE = 1024;
+
+	struct Stage {
+		const char* name;
+		/** Durations of the last HISTORY_SIZE calls.
+		Written by the engine thread and read by the UI thread, so relaxed atomics keep the statistics race-free without fences.
+		*/
+		std::atomic<uint32_t> history[HISTORY_SIZE];
+		std::atomic<uint32_t> count;
+	};
+
+	const char* name;
+	Stage stages[MAX_STAGES];
+	int numStages = 0;
+
+	Profiler(const char* name, std::initializer_list<const char*> stageNames) : name(name) {
+		for (const char* stageName : stageNames) {
+			assert(numStages < MAX_STAGES);
+			stages[numStages++].name = stageName;
+		}
+		reset();
+	}
+
+	static uint64_t now() {
+#if defined __x86_64__ || defined __i386__
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	/** Unit of the durations returned by now() */
+	static const char* getUnit() {
+#if defined __x86_64__ || defined __i386__
+		return "cycles";
+#else
+		return "ns";
+#endif
+	}
+
+	void record(int stage, uint64_t duration) {
+		Stage& s = stages[stage];
+		uint32_t count = s.count.load(std::memory_order_relaxed);
+		s.history[count % HISTORY_SIZE].store((uint32_t) std::min<uint64_t>(duration, UINT32_MAX), std::memory_order_relaxed);
+		s.count.store(count + 1, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		for (int i = 0; i < numStages; i++) {
+			stages[i].count.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	struct Stats {
+		uint32_t min = 0;
+		float mean = 0.f;
+		uint32_t p99 = 0;
+		int count = 0;
+	};
+
+	/** Computes statistics over the rolling history of a stage. Call from the UI thread. */
+	Stats getStats(int stage) {
+		Stage& s = stages[stage];
+		Stats stats;
+		stats.count = std::min<uint32_t>(s.count.load(std::memory_order_relaxed), HISTORY_SIZE);
+		if (stats.count == 0)
+			return stats;
+
+		std::vector<uint32_t> durations(stats.count);
+		uint64_t sum = 0;
+		for (int i = 0; i < stats.count; i++) {
+			durations[i] = s.history[i].load(std::memory_order_relaxed);
+			sum += durations[i];
+		}
+		stats.min = *std::min_element(durations.begin(), durations.end());
+		stats.mean = (float) sum / stats.count;
+		auto p99 = durations.begin() + (stats.count - 1) * 99 / 100;
+		std::nth_element(durations.begin(), p99, durations.end());
+		stats.p99 = *p99;
+		return stats;
+	}
+};
+
+
+struct ProfileScope {
+	Profiler& profiler;
+	int stage;
+	uint64_t start;
+	uint64_t traceStart = 0;
+
+	ProfileScope(Profiler& profiler, int stage) : profiler(profiler), stage(stage) {
+		if (stage > 0 && isTracing())
+			traceStart = getTraceTime();
+		start = Profiler::now();
+	}
+
+	~ProfileScope() {
+		profiler.record(stage, Profiler::now() - start);
+		if (traceStart)
+			traceEvent(profiler.name, profiler.stages[stage].name, &profiler, traceStart, getTraceTime());
+	}
+};
+
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(profiler, stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(profiler, stage)
+
+
+/** Adds a submenu listing min/mean/p99 durations of each stage. */
+inline void appendProfilerMenu(rack::ui::Menu* menu, Profiler* profiler) {
+	using namespace rack;
+	menu->addChild(new MenuSeparator);
+	menu->addChild(createSubmenuItem("Profiler", "", [=](Menu* menu) {
+		menu->addChild(createMenuLabel(string::f("Last %d calls, in %s", Profiler::HISTORY_SIZE, Profiler::getUnit())));
+		for (int i = 0; i < profiler->numStages; i++) {
+			Profiler::Stats stats = profiler->getStats(i);
+			menu->addChild(createMenuLabel(string::f("%s: min %u, mean %.0f, p99 %u", profiler->stages[i].name, stats.min, stats.mean, stats.p99)));
+		}
+		menu->addChild(createMenuItem("Reset", "", [=]() {profiler->reset();}));
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createBoolMenuItem("Record Chrome trace of all modules", "",
+			[=]() {return isTracing();},
+			[=](bool tracing) {
+				if (tracing)
+					startTrace();
+				else
+					stopTrace();
+			}
+		));
+	}));
+}
+
+#else
+
+struct Profiler {
+	Profiler(const char* name, std::initializer_list<const char*> stageNames) {}
+};
+
+#define PROFILE_SCOPE(profiler, stage)
+
+inline void appendProfilerMenu(rack::ui::Menu* menu, Profiler* profiler) {}
+
+#endif
@@ -0,0 +1,252 @@
+// Renders a patch containing only Audible Instruments modules to a WAV file, as fast as the CPU allows.
+//
+// Build with `make render`, which links the plugin's objects against libRack.
+//
+// Usage:
+// 	render [options] <patch.vcv> <output.wav>
+//
+// Options:
+// 	-o <moduleId>:<outputId>  Record an output port. Repeat for more WAV channels, one per port.
+// 	-l <seconds>              Length to render (default 60)
+// 	-r <sample rate>          Engine sample rate (default 48000)
+// 	-t <threads>              Engine threads (default 1)
+//
+// Modules from other plugins are skipped, along with their cables.
+// Polyphonic outputs are summed, and 10 V is written as full scale, like Core's Audio module.
+
+#include "../src/plugin.hpp"
+#include <set>
+#include <getopt.h>
+
+
+/** Collects the voltages at its inputs during each engine block, for the main thread to write out between blocks. */
+struct Recorder : Module {
+	std::vector<float> buffer;
+
+	Recorder(int channels) {
+		config(0, channels, 0, 0);
+	}
+
+	void process(const ProcessArgs& args) override {
+		for (Input& input : inputs) {
+			buffer.push_back(input.getVoltageSum() / 10.f);
+		}
+	}
+};
+
+
+struct WavWriter {
+	FILE* file = NULL;
+	int channels;
+	uint32_t dataSize = 0;
+
+	bool open(const std::string& path, int channels, int sampleRate) {
+		this->channels = channels;
+		file = std::fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+		writeHeader(sampleRate);
+		return true;
+	}
+
+	void write32(uint32_t x) {
+		std::fwrite(&x, sizeof(x), 1, file);
+	}
+
+	void write16(uint16_t x) {
+		std::fwrite(&x, sizeof(x), 1, file);
+	}
+
+	/** Writes a 32-bit float WAV header. Sizes are patched in by close(). */
+	void writeHeader(int sampleRate) {
+		std::fwrite("RIFF", 1, 4, file);
+		write32(36 + dataSize);
+		std::fwrite("WAVEfmt ", 1, 8, file);
+		write32(16);
+		// WAVE_FORMAT_IEEE_FLOAT
+		write16(3);
+		write16(channels);
+		write32(sampleRate);
+		write32(sampleRate * channels * sizeof(float));
+		write16(channels * sizeof(float));
+		write16(32);
+		std::fwrite("data", 1, 4, file);
+		write32(dataSize);
+	}
+
+	void write(const std::vector<float>& samples) {
+		std::fwrite(samples.data(), sizeof(float), samples.size(), file);
+		dataSize += samples.size() * sizeof(float);
+	}
+
+	void close(int sampleRate) {
+		std::fseek(file, 0, SEEK_SET);
+		writeHeader(sampleRate);
+		std::fclose(file);
+		file = NULL;
+	}
+};
+
+
+/** Unpacks the patch into `dir` if it is an archive, and parses its JSON. */
+static json_t* loadPatch(const std::string& path, const std::string& dir) {
+	std::string patchPath = path;
+	// Rack 2 patches are archives containing patch.json and the modules' patch storage. Older patches are plain JSON.
+	if (system::getExtension(path) == ".vcv") {
+		try {
+			system::unarchiveToDirectory(path, dir);
+			patchPath = system::join(dir, "patch.json");
+		}
+		catch (Exception& e) {
+			// Not an archive, so try reading it as JSON
+			patchPath = path;
+		}
+	}
+
+	json_error_t error;
+	json_t* rootJ = json_load_file(patchPath.c_str(), 0, &error);
+	if (!rootJ)
+		std::fprintf(stderr, "Could not parse %s: %s line %d\n", path.c_str(), error.text, error.line);
+	return rootJ;
+}
+
+
+/** Removes modules of other plugins and the cables connected to them, which Engine::fromJson() could not load anyway. */
+static void filterPatch(json_t* rootJ) {
+	std::set<int64_t> moduleIds;
+	json_t* modulesJ = json_object_get(rootJ, "modules");
+	for (size_t i = 0; i < json_array_size(modulesJ);) {
+		json_t* moduleJ = json_array_get(modulesJ, i);
+		const char* pluginSlug = json_string_value(json_object_get(moduleJ, "plugin"));
+		if (pluginSlug && std::string(pluginSlug) == pluginInstance->slug) {
+			moduleIds.insert(json_integer_value(json_object_get(moduleJ, "id")));
+			i++;
+		}
+		else {
+			std::fprintf(stderr, "Skipping %s %s\n", pluginSlug, json_string_value(json_object_get(moduleJ, "model")));
+			json_array_remove(modulesJ, i);
+		}
+	}
+
+	json_t* cablesJ = json_object_get(rootJ, "cables");
+	for (size_t i = 0; i < json_array_size(cablesJ);) {
+		json_t* cableJ = json_array_get(cablesJ, i);
+		int64_t outputModuleId = json_integer_value(json_object_get(cableJ, "outputModuleId"));
+		int64_t inputModuleId = json_integer_value(json_object_get(cableJ, "inputModuleId"));
+		if (moduleIds.count(outputModuleId) && moduleIds.count(inputModuleId))
+			i++;
+		else
+			json_array_remove(cablesJ, i);
+	}
+}
+
+
+static void printUsage() {
+	std::fprintf(stderr, "Usage: render [-o moduleId:outputId]... [-l seconds] [-r sampleRate] [-t threads] <patch.vcv> <output.wav>\n");
+}
+
+
+int main(int argc, char* argv[]) {
+	float length = 60.f;
+	int sampleRate = 48000;
+	int threads = 1;
+	std::vector<std::pair<int64_t, int>> ports;
+
+	int c;
+	while ((c = getopt(argc, argv, "o:l:r:t:h")) != -1) {
+		switch (c) {
+			case 'o': {
+				long long moduleId;
+				int outputId;
+				if (std::sscanf(optarg, "%lld:%d", &moduleId, &outputId) != 2) {
+					printUsage();
+					return 1;
+				}
+				ports.push_back({moduleId, outputId});
+			} break;
+			case 'l': length = std::atof(optarg); break;
+			case 'r': sampleRate = std::atoi(optarg); break;
+			case 't': threads = std::atoi(optarg); break;
+			default: printUsage(); return 1;
+		}
+	}
+	if (argc - optind != 2 || ports.empty() || sampleRate <= 0 || threads <= 0) {
+		printUsage();
+		return 1;
+	}
+	std::string patchPath = argv[optind];
+	std::string wavPath = argv[optind + 1];
+
+	// Like running Rack with -d, log to stderr and keep the system and user folders in the working directory
+	settings::devMode = true;
+	random::init();
+	asset::init();
+	logger::init();
+
+	// Register this plugin in-process, so Engine::fromJson() finds its models by slug
+	Plugin* p = new Plugin;
+	p->slug = "AudibleInstruments";
+	p->name = "Audible Instruments";
+	init(p);
+	plugin::plugins.push_back(p);
+
+	contextSet(new Context);
+	APP->engine = new engine::Engine;
+	APP->engine->setSampleRate(sampleRate);
+	// Engine::stepBlock() starts this many worker threads and spreads modules over them
+	settings::threadCount = threads;
+
+	// Modules find their patch storage in the unpacked patch, like Rack's autosave folder
+	std::string patchDir = system::join(system::getTempDirectory(), string::f("AudibleInstruments-render-%d", (int) random::u32()));
+	system::createDirectories(patchDir);
+	APP->patch = new patch::Manager;
+	APP->patch->autosavePath = patchDir;
+
+	json_t* rootJ = loadPatch(patchPath, patchDir);
+	if (!rootJ)
+		return 1;
+	filterPatch(rootJ);
+	APP->engine->fromJson(rootJ);
+	json_decref(rootJ);
+	// Modules output silence until their DSP state is built, which would make renders differ from run to run
+	waitForBackgroundInits();
+	// Background inits may still be reading patch storage until now
+	system::removeRecursively(patchDir);
+
+	Recorder* recorder = new Recorder(ports.size());
+	APP->engine->addModule(recorder);
+	for (size_t i = 0; i < ports.size(); i++) {
+		Module* module = APP->engine->getModule(ports[i].first);
+		if (!module || ports[i].second < 0 || ports[i].second >= (int) module->outputs.size()) {
+			std::fprintf(stderr, "No output %d on module %lld\n", ports[i].second, (long long) ports[i].first);
+			return 1;
+		}
+		engine::Cable* cable = new engine::Cable;
+		cable->outputModule = module;
+		cable->outputId = ports[i].second;
+		cable->inputModule = recorder;
+		cable->inputId = i;
+		APP->engine->addCable(cable);
+	}
+
+	WavWriter wav;
+	if (!wav.open(wavPath, ports.size(), sampleRate)) {
+		std::fprintf(stderr, "Could not write %s\n", wavPath.c_str());
+		return 1;
+	}
+
+	const int blockFrames = 4096;
+	int64_t frames = (int64_t) (length * sampleRate);
+	recorder->buffer.reserve(blockFrames * ports.size());
+	double startTime = system::getTime();
+	for (int64_t frame = 0; frame < frames; frame += blockFrames) {
+		APP->engine->stepBlock(std::min<int64_t>(blockFrames, frames - frame));
+		wav.write(recorder->buffer);
+		recorder->buffer.clear();
+	}
+	wav.close(sampleRate);
+
+	double duration = system::getTime() - startTime;
+	std::fprintf(stderr, "Rendered %g s in %g s (%gx realtime)\n", length, duration, length / duration);
+	return 0;
+}